@@ -0,0 +1,134 @@
+// Copyright (c) 2017, Robert Escriva
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of ygor nor the names of its contributors may be used
+//       to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// C
+#include <stdint.h>
+#include <time.h>
+
+// POSIX
+#include <pthread.h>
+
+// ygor
+#include <ygor/clock.h>
+#include "visibility.h"
+
+static pthread_once_t calibrate_once = PTHREAD_ONCE_INIT;
+static uint64_t cycles_per_second = 0;
+
+static uint64_t
+monotonic_nanos()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// A frequency-scaled or stopped counter cannot be converted to time
+static bool
+invariant_tsc()
+{
+#if defined(__x86_64__)
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t d;
+    __asm__ ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (0x80000000U));
+
+    if (a < 0x80000007U)
+    {
+        return false;
+    }
+
+    __asm__ ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (0x80000007U));
+    return d & (1U << 8);
+#else
+    return true;
+#endif
+}
+
+// Read the monotonic clock and the counter together, retrying until a read of
+// the clock is not interrupted, so that the two describe the same instant.
+static void
+sample(uint64_t* nanos, uint64_t* cycles)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (unsigned i = 0; i < 16; ++i)
+    {
+        const uint64_t before = ygor_clock_cycles();
+        const uint64_t n = monotonic_nanos();
+        const uint64_t after = ygor_clock_cycles_end();
+
+        if (after - before < best)
+        {
+            best = after - before;
+            *nanos = n;
+            *cycles = before + (after - before) / 2;
+        }
+    }
+}
+
+static void
+calibrate()
+{
+    if (!invariant_tsc())
+    {
+        return;
+    }
+
+    uint64_t start_nanos;
+    uint64_t start_cycles;
+    uint64_t end_nanos;
+    uint64_t end_cycles;
+    sample(&start_nanos, &start_cycles);
+    timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = YGOR_CLOCK_CALIBRATION_MS * 1000000L;
+
+    while (nanosleep(&ts, &ts) < 0)
+    {
+    }
+
+    sample(&end_nanos, &end_cycles);
+
+    if (end_nanos > start_nanos && end_cycles > start_cycles)
+    {
+        cycles_per_second = (end_cycles - start_cycles) * 1e9 / (end_nanos - start_nanos) + 0.5;
+    }
+}
+
+extern "C"
+{
+
+YGOR_API uint64_t
+ygor_clock_cycles_per_second(void)
+{
+    pthread_once(&calibrate_once, calibrate);
+    return cycles_per_second;
+}
+
+} // extern "C"
@@ -25,6 +25,12 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#define __STDC_LIMIT_MACROS
+
+// C
+#include <math.h>
+#include <stdint.h>
+
 // POSIX
 #include <err.h>
 #include <sys/stat.h>
@@ -41,6 +47,8 @@ units_to_str(ygor_units u)
         case YGOR_UNIT_S: return "s";
         case YGOR_UNIT_MS: return "ms";
         case YGOR_UNIT_US: return "us";
+        case YGOR_UNIT_NS: return "ns";
+        case YGOR_UNIT_CYCLES: return "cycles";
         case YGOR_UNIT_BYTES: return "B";
         case YGOR_UNIT_KBYTES: return "KB";
         case YGOR_UNIT_MBYTES: return "MB";
@@ -84,6 +92,14 @@ str_to_units(const char* _suffix, ygor_units* u)
     {
         *u = YGOR_UNIT_GBYTES;
     }
+    else if (suffix == "ns")
+    {
+        *u = YGOR_UNIT_NS;
+    }
+    else if (suffix == "cycles")
+    {
+        *u = YGOR_UNIT_CYCLES;
+    }
     else if (suffix == "monotonic")
     {
         *u = YGOR_UNIT_MONOTONIC;
@@ -283,3 +299,120 @@ bucket_options :: validate()
     m_bucket *= ratio;
     return m_bucket > 0;
 }
+
+// A value with optional units; without them it is in the series' own units
+static bool
+parse_bound(const char* str, uint64_t* value, ygor_units* units)
+{
+    char* end = NULL;
+    *value = strtoull(str, &end, 10);
+
+    if (end == str)
+    {
+        return false;
+    }
+
+    if (*end == '\0')
+    {
+        *units = YGOR_UNIT_UNIT;
+        return true;
+    }
+
+    return str_to_units(end, units);
+}
+
+// Convert a bound, rounding down (or up) to a whole value in the new units so
+// that the window only ever widens to take in the whole units it overlaps
+static bool
+bound_to_units(uint64_t value, ygor_units from, ygor_units to, bool round_up, uint64_t* out)
+{
+    if (from == YGOR_UNIT_UNIT || from == to)
+    {
+        *out = value;
+        return true;
+    }
+
+    if (!ygor_units_compatible(from, to))
+    {
+        return false;
+    }
+
+    const double converted = value * ygor_units_conversion_ratio(from, to);
+    const double rounded = round_up ? ceil(converted) : floor(converted);
+    *out = rounded < double(UINT64_MAX) ? uint64_t(rounded) : UINT64_MAX;
+    return true;
+}
+
+window_options :: window_options()
+    : m_ap()
+    , m_start_str(NULL)
+    , m_end_str(NULL)
+    , m_start(0)
+    , m_end(UINT64_MAX)
+    , m_start_units(YGOR_UNIT_UNIT)
+    , m_end_units(YGOR_UNIT_UNIT)
+{
+    m_ap.arg().long_name("start")
+              .description("Skip points before this independent value (default: from the first)")
+              .as_string(&m_start_str);
+    m_ap.arg().long_name("end")
+              .description("Skip points from this independent value on (default: to the last)")
+              .as_string(&m_end_str);
+}
+
+const e::argparser&
+window_options :: parser()
+{
+    return m_ap;
+}
+
+bool
+window_options :: validate()
+{
+    if (m_start_str && !parse_bound(m_start_str, &m_start, &m_start_units))
+    {
+        return false;
+    }
+
+    if (m_end_str && !parse_bound(m_end_str, &m_end, &m_end_units))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+ygor_data_iterator*
+window_options :: apply(ygor_data_iterator* ydi)
+{
+    if (!m_start_str && !m_end_str)
+    {
+        return ydi;
+    }
+
+    const ygor_series* s = ygor_data_iterator_series(ydi);
+    uint64_t start = 0;
+    uint64_t end = UINT64_MAX;
+
+    // a window in time over a series in cycles converts the series first
+    if (!bounds(s->indep_units, &start, &end))
+    {
+        const ygor_units u = m_start_str && m_start_units != YGOR_UNIT_UNIT
+                           ? m_start_units : m_end_units;
+
+        if (!bounds(u, &start, &end) ||
+            !(ydi = ygor_data_convert_units(ydi, u, s->dep_units)))
+        {
+            return NULL;
+        }
+    }
+
+    return ygor_data_window(ydi, start, end);
+}
+
+bool
+window_options :: bounds(ygor_units u, uint64_t* start, uint64_t* end)
+{
+    return (!m_start_str || bound_to_units(m_start, m_start_units, u, false, start)) &&
+           (!m_end_str || bound_to_units(m_end, m_end_units, u, true, end));
+}
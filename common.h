@@ -106,4 +106,37 @@ class bucket_options
         ygor_units m_bucket_units;
 };
 
+// --start and --end, each a value of the series' independent variable with
+// optional units, as for the bucket size.  Bounds finer than the series'
+// units widen to the whole units they fall in: --start 1500ms --end 2500ms
+// over a series in seconds keeps [1s, 3s).
+class window_options
+{
+    public:
+        window_options();
+
+    public:
+        const e::argparser& parser();
+        bool validate();
+        // restrict ydi to the window, converting it to the window's units if
+        // it must be; ydi itself if no window was given, and NULL on error
+        ygor_data_iterator* apply(ygor_data_iterator* ydi);
+
+    private:
+        bool bounds(ygor_units u, uint64_t* start, uint64_t* end);
+
+    private:
+        window_options(const window_options&);
+        window_options& operator = (const window_options&);
+
+    private:
+        e::argparser m_ap;
+        const char* m_start_str;
+        const char* m_end_str;
+        uint64_t m_start;
+        uint64_t m_end;
+        ygor_units m_start_units;
+        ygor_units m_end_units;
+};
+
 #endif // ygor_common_h_
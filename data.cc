@@ -27,29 +27,54 @@
 
 #define __STDC_LIMIT_MACROS
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 // C
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+// POSIX
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
 // STL
+#include <algorithm>
 #include <list>
+#include <map>
+#include <string>
 #include <vector>
 
 // po6
+#include <po6/threads/cond.h>
 #include <po6/threads/mutex.h>
+#include <po6/threads/thread.h>
+#include <po6/time.h>
 
 // e
 #include <e/ao_hash_map.h>
+#include <e/atomic.h>
 #include <e/endian.h>
 #include <e/guard.h>
 #include <e/lookup3.h>
 #include <e/varint.h>
 
 // ygor
+#include <ygor/clock.h>
 #include <ygor/data.h>
 #include <ygor/guacamole.h>
 #include "halffloat.h"
+#include "histogram.h"
 #include "ygor-internal.h"
 #include "visibility.h"
 
@@ -62,6 +87,65 @@ hash_ptr(T* t)
 
 #define MAX_POINT_SIZE 20
 #define SERIES_BUFFER_SIZE 1024
+#define MAX_SERIES_BUFFER_SIZE 1048576
+// the most points the analyses read from an iterator at a time
+#define READ_BATCH_SIZE 1024
+// the most threads one iterator may decode with
+#define MAX_SCAN_THREADS 256
+// no valid block is larger than this; readers treat larger lengths as corrupt
+#define MAX_BLOCK_BYTES (2 * VARINT_64_MAX_SIZE + MAX_SERIES_BUFFER_SIZE * MAX_POINT_SIZE + 1)
+
+// Blocks whose series index is at or above METADATA_BLOCK describe the file
+// rather than holding points.  Iterators skip them like any other series'
+// blocks, so readers that predate a kind of metadata block ignore it.
+#define METADATA_BLOCK 0xfffe0000U
+// Written immediately after the header; a sequence of (key, series, value)
+// varint triples that readers need to interpret the series' blocks.
+#define CONFIG_BLOCK (METADATA_BLOCK + 0)
+// A chunk of the block index: the offset of the previous chunk plus one (zero
+// for the first), a count, and that many (series, offset, count) varints each
+// followed by the block's minimum and maximum independent values as 64-bit
+// big-endian words, and then its summary: a varint count of values and the
+// sum and sum of squares of the independent values, and the minimum, maximum,
+// sum, and sum of squares of the dependent values as big-endian doubles.
+// Chunks are written as entries accumulate.
+#define INDEX_BLOCK (METADATA_BLOCK + 1)
+// The last block of a cleanly closed file: the 64-bit big-endian offset of
+// the last index chunk and INDEX_MAGIC.  Its size is fixed so that readers can
+// find it from the end of the file.
+#define TRAILER_BLOCK (METADATA_BLOCK + 2)
+#define INDEX_MAGIC "ygoridx"
+#define TRAILER_SIZE (2 * sizeof(uint64_t) + 5 + sizeof(INDEX_MAGIC))
+// small enough that a chunk fits the fixed block buffer of older readers
+#define INDEX_CHUNK_ENTRIES 128
+#define INDEX_ENTRY_SIZE (4 * VARINT_64_MAX_SIZE + 8 * sizeof(uint64_t))
+
+enum config_key
+{
+    CONFIG_BLOCK_SIZE = 1,
+    CONFIG_ENCODING = 2,
+    CONFIG_HISTOGRAM_INTERVAL = 3,
+    CONFIG_HISTOGRAM_PRECISION = 4,
+    // points of one-in-n and reservoir samples each stand for this many
+    CONFIG_SAMPLING_RATIO = 5,
+    // the rate of ygor_clock_cycles, for series with values in cycles
+    CONFIG_CYCLES_PER_SECOND = 6
+};
+
+#define KNOWN_ENCODINGS (YGOR_ENCODING_DELTA_OF_DELTA | YGOR_ENCODING_XOR | YGOR_ENCODING_COLUMNAR)
+// Not an encoding callers choose, but recorded as one for histogram series so
+// that readers which predate them refuse the series instead of misreading its
+// blocks.  Each of their blocks is a snapshot: the varint start of the
+// interval it covers followed by the histogram's packed buckets.
+#define ENCODING_HISTOGRAM 0x10000U
+
+// the logger's pool allocates blocks of points this many at a time
+#define BLOCKS_PER_SLAB 16
+// the number of writes a uring_writer keeps in flight
+#define URING_DEPTH 64
+
+// readers open this many segments of a segmented output at once
+#define SEGMENT_READER_THREADS 8
 
 YGOR_API int
 ygor_is_precise(ygor_precision p)
@@ -92,1272 +176,7145 @@ approximate_precision(ygor_precision p)
     }
 }
 
-typedef bool (*sort_func_t)(const ygor_data_point& lhs, const ygor_data_point& rhs);
+// The series that the drop overload policy counts dropped points into
+static ygor_series dropped_series = {"ygor.dropped", YGOR_UNIT_MS, YGOR_PRECISE_INTEGER,
+                                     YGOR_UNIT_UNIT, YGOR_PRECISE_INTEGER};
+
+// The name of one segment of output written with segment rollover
+static std::string
+segment_name(const std::string& output, unsigned segment)
+{
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), ".%04u", segment);
+    return output + suffix;
+}
+
+static double
+value_to_double(ygor_precision p, const ygor_data_value& v)
+{
+    return ygor_is_precise(p) ? double(v.precise) : v.approximate;
+}
+
+// The value a reader decodes once v is packed at precision p
+static ygor_data_value
+quantize(ygor_precision p, ygor_data_value v)
+{
+    if (p == YGOR_HALF_PRECISION)
+    {
+        v.approximate = halffloat_decompress(halffloat_compress(v.approximate));
+    }
+    else if (p == YGOR_SINGLE_PRECISION)
+    {
+        v.approximate = float(v.approximate);
+    }
+
+    return v;
+}
+
+// Whether an independent value falls short of indep
+static bool
+indep_before(ygor_precision p, const ygor_data_value& v, uint64_t indep)
+{
+    return ygor_is_precise(p) ? v.precise < indep : v.approximate < double(indep);
+}
+
+typedef void (*sort_func_t)(ygor_data_point* points, size_t points_sz, std::vector<ygor_data_point>* scratch);
 typedef unsigned char* (*pack_func_t)(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out);
 typedef const unsigned char* (*unpack_func_t)(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point);
+// Series with a non-default encoding pack and unpack whole blocks at once so
+// that the encoding may carry state (like a partially written byte) across
+// points.
+typedef unsigned char* (*pack_block_func_t)(const ygor_data_point* points, size_t points_sz, unsigned char* out);
+typedef bool (*unpack_block_func_t)(const unsigned char* in, const unsigned char* end, const ygor_series* s, bool skip_indep, std::vector<ygor_data_point>* points);
+
+// The batch recording calls differ only in where the points come from; these
+// copy a run of points from the caller into a block.
+struct point_batch
+{
+    point_batch(const ygor_data_point* ydp);
+    void copy(size_t off, size_t n, ygor_data_point* out) const;
+
+    const ygor_data_point* points;
+};
+
+struct column_batch
+{
+    column_batch(const ygor_series* s, const ygor_data_value* indep, const ygor_data_value* dep);
+    void copy(size_t off, size_t n, ygor_data_point* out) const;
+
+    const ygor_series* series;
+    const ygor_data_value* indep;
+    const ygor_data_value* dep;
+};
+
+// Statistics over the values in one block.  Each block's index entry carries
+// one so that analyses can account for the block without decoding it.  count
+// is the number of values recorded, which differs from the number of points
+// only for histogram snapshots.
+struct block_summary
+{
+    block_summary();
+    void add(double indep, double dep, uint64_t weight);
+    // as if every value were recorded weight times
+    void scale(uint64_t weight);
+    void add(const block_summary& other);
+
+    uint64_t count;
+    double indep_sum;
+    double indep_sumsq;
+    double dep_min;
+    double dep_max;
+    double dep_sum;
+    double dep_sumsq;
+};
+
+// The options that apply to just one series
+struct series_options
+{
+    series_options();
+    series_options(const ygor_series* s);
+
+    const ygor_series* series;
+    unsigned encoding;
+    // zero unless the series is a histogram
+    uint64_t histogram_interval;
+    unsigned histogram_precision;
+    // zero unless the series is sampled
+    unsigned sampling;
+    uint64_t sampling_n;
+    uint64_t sampling_interval;
+};
 
 struct ygor_series_logger
 {
     static sort_func_t sort_func(const ygor_series* s);
     static pack_func_t pack_func(const ygor_series* s);
+    static pack_block_func_t pack_block_func(const ygor_series* s, unsigned encoding);
 
-    ygor_series_logger(ygor_data_logger* dl, const ygor_series* s);
+    ygor_series_logger(ygor_data_logger* dl, const ygor_series* s, const series_options& so);
     ~ygor_series_logger() throw ();
 
+    // whether a sampled series keeps the point; true for every point of a
+    // series that is not sampled
+    bool sample(const ygor_data_value& indep);
+    // the ratio recorded for the series, or zero if points are not weighted
+    uint64_t sampling_ratio() const;
     int record(ygor_data_point* ydp);
+    template <typename B> int record_batch(const B& batch, size_t batch_sz);
+    // call holding points_mtx with a full block; releases points_mtx
+    int hand_off_full();
+    // under the drop policy, a full block is written only if no other write
+    // of the series is under way, instead of waiting for io_mtx
+    bool claim_write();
+    void release_write();
     int flush();
-    // call holding io_mtx;
+    // call holding io_mtx
     int write(ygor_data_point* points, size_t points_sz);
+    int aggregate(const ygor_data_point* points, size_t points_sz);
+    int write_snapshot();
+    // write out the partial histogram, if any; call holding io_mtx
+    int finish();
 
     ygor_data_logger* ydl;
     const ygor_series* ys;
     size_t sindex;
+    // sample() updates these atomically, without taking points_mtx.  The
+    // reservoir caches each run's chosen point as the low 32 bits of
+    // sample_state, tagged with the run number (plus one) in the high 32 bits.
+    // Throttled series count points kept in sample_state the same way, tagged
+    // with the interval.
+    unsigned sampling;
+    uint64_t sampling_n;
+    uint64_t sampling_interval;
+    uint64_t sample_seen;
+    uint64_t sample_state;
     // the series logger uses a double-buffer flip-flop
     // While one set of points are being filled in, the other is being written
     // out to the data logger.  The goal is for the buffering to never get to a
-    // state that it is waiting on the data to be written out.  The "points"
-    // array will point to either points_A or points_B.
+    // state that it is waiting on the data to be written out.  "points" is
+    // filled while "spare" (guarded by io_mtx) holds the block last written.
+    // With a background writer, "points" is instead swapped for an empty block
+    // from the logger each time it fills, and there is no spare.  Blocks come
+    // from the logger's pool on first use and go back to it on flush, so
+    // series that record nothing hold no blocks.
     po6::threads::mutex points_mtx;
-    ygor_data_point points_A[SERIES_BUFFER_SIZE];
-    ygor_data_point points_B[SERIES_BUFFER_SIZE];
     ygor_data_point* points;
     size_t points_sz;
     // The I/O path takes the in memory representation and compacts it according
     // to the series description
     po6::threads::mutex io_mtx;
+    ygor_data_point* spare;
+    uint32_t writing;
+    unsigned encoding;
     sort_func_t sort;
     pack_func_t pack;
+    pack_block_func_t pack_block;
+    std::vector<ygor_data_point> sort_scratch;
+    std::vector<unsigned char> io_buf;
+    // histogram series add each written block to hist instead, and write one
+    // snapshot of it per interval of independent values
+    uint64_t hist_interval;
+    histogram* hist;
+    uint64_t hist_window;
+    block_summary hist_summary;
 
     private:
         ygor_series_logger(const ygor_series_logger&);
         ygor_series_logger& operator = (const ygor_series_logger&);
 };
 
+struct ygor_data_logger_config
+{
+    ygor_data_logger_config();
+    ~ygor_data_logger_config() throw ();
+
+    series_options options(const ygor_series* s) const;
+    series_options* options(const ygor_series* s);
+
+    bool thread_local_buffers;
+    bool background_writer;
+    int writer_cpu;
+    size_t block_size;
+    uint64_t flush_interval;
+    uint64_t segment_bytes;
+    uint64_t segment_interval;
+    uint64_t preallocate;
+    bool io_uring;
+    uint64_t memory_budget;
+    ygor_overload_policy overload_policy;
+    // the rate to record for series in cycles, or zero to calibrate it
+    uint64_t cycles_per_second;
+    std::vector<series_options> per_series;
+};
+
+// Where one block of points lies in the file.  min and max hold the raw bits
+// of the block's first and last independent values.
+struct index_entry
+{
+    index_entry();
+    index_entry(uint64_t series, uint64_t offset, uint64_t count,
+                uint64_t min, uint64_t max, const block_summary& summary);
+
+    uint64_t series;
+    uint64_t offset;
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    block_summary summary;
+};
+
+// A full (or flushed) block waiting for the background writer
+struct pending_block
+{
+    pending_block();
+    pending_block(ygor_series_logger* ysl, ygor_data_point* points, size_t points_sz);
+
+    ygor_series_logger* ysl;
+    ygor_data_point* points;
+    size_t points_sz;
+};
+
+// An output file written with pwrite instead of stdio.  Each write reserves
+// its range of the file holding the logger's output_mtx and is then done
+// without it.  The file is extended in extents so that concurrent writes past
+// its end do not each grow it, and is cut back to the reserved size when
+// closed.
+struct direct_output
+{
+    direct_output(int fd);
+    ~direct_output() throw ();
+
+    // call holding output_mtx
+    void reserve(uint64_t end, uint64_t extent);
+    int write_at(const unsigned char* buf, size_t buf_sz, uint64_t offset);
+    int finish();
+
+    int fd;
+    uint64_t allocated;
+    // writes reserved but not yet done
+    unsigned pending;
+    // set once the logger has moved on; the last pending write then finishes
+    // the file at size
+    bool retired;
+    uint64_t size;
+
+    private:
+        direct_output(const direct_output&);
+        direct_output& operator = (const direct_output&);
+};
+
+// Writes the blocks of direct output asynchronously through io_uring, so that
+// the thread that packed a block does not wait for it to be written.  Each
+// block is copied into one of a pool of buffers registered with the ring, and
+// the buffer returns to the pool (and the block's reservation in its
+// direct_output is released) when the write completes.  Without liburing, or
+// when the kernel refuses the ring, init fails and the logger writes with
+// pwrite instead.  Lock order: mtx, then the logger's output_mtx.
+struct uring_writer
+{
+    uring_writer(ygor_data_logger* dl);
+    ~uring_writer() throw ();
+
+    bool init(unsigned depth, size_t buffer_sz);
+    // takes over the pending write to d; false leaves it to the caller, as
+    // when the block is too big for a buffer
+    bool submit(direct_output* d, const unsigned char* buf, size_t buf_sz, uint64_t offset);
+    // wait for every submitted write
+    int drain();
+#ifdef HAVE_LIBURING
+    // call holding mtx
+    bool reap(bool wait);
+    void complete(size_t idx, int res);
+#endif
+
+    ygor_data_logger* ydl;
+    po6::threads::mutex mtx;
+#ifdef HAVE_LIBURING
+    io_uring ring;
+#endif
+    bool ring_ready;
+    size_t buffer_sz;
+    std::vector<unsigned char*> buffers;
+    std::vector<size_t> free_buffers;
+    // where each buffer in flight is being written
+    std::vector<direct_output*> targets;
+    std::vector<size_t> sizes;
+    std::vector<uint64_t> offsets;
+    size_t in_flight;
+    bool failed;
+
+    private:
+        uring_writer(const uring_writer&);
+        uring_writer& operator = (const uring_writer&);
+};
+
+// When thread-local buffers are enabled, each recording thread gets one of
+// these per logger, with a block for each series it records into.  Blocks are
+// allocated on first use and handed to the series logger once full.
+struct thread_buffers
+{
+    thread_buffers(ygor_data_logger* dl);
+    ~thread_buffers() throw ();
+
+    int record(ygor_series_logger* ysl, ygor_data_point* ydp);
+    template <typename B> int record_batch(ygor_series_logger* ysl, const B& batch, size_t batch_sz);
+    int flush();
+
+    ygor_data_logger* ydl;
+    // held by the owning thread as it records, and by flushes from others
+    po6::threads::mutex mtx;
+    std::vector<ygor_data_point*> points;
+    std::vector<size_t> points_sz;
+
+    private:
+        thread_buffers(const thread_buffers&);
+        thread_buffers& operator = (const thread_buffers&);
+};
+
 struct ygor_data_logger
 {
     ygor_data_logger();
     ~ygor_data_logger() throw ();
 
-    bool init(const char* output,
+    bool init(const char* path,
               const ygor_series** series,
-              size_t series_sz);
+              size_t series_sz,
+              const ygor_data_logger_config* config);
     size_t series_index(const ygor_series* s);
     ygor_series_logger* get_series_logger(const ygor_series* s);
+    ygor_series_logger* get_series_logger(ygor_series_handle h);
+    thread_buffers* get_thread_buffers();
+    void release_thread_buffers(thread_buffers* tb);
+    int flush_thread_buffers();
+    ygor_data_point* allocate_block();
+    // may_drop permits the overload policy to drop the points
+    int hand_off(ygor_series_logger* ysl, ygor_data_point** points, size_t points_sz, bool may_drop);
+    void release_block(ygor_data_point* points);
+    void count_dropped(uint64_t points);
+    int record_dropped();
+    void writer();
+    int drain_writer();
+    int stop_writer();
+    int flush();
+    void flusher();
+    int stop_flusher();
+
+    // call holding output_mtx
+    bool open_segment();
+    int roll_segment();
+    int close_output();
+    int release_direct(direct_output* d);
+    bool append(const unsigned char* buf, size_t buf_sz);
+    bool write_header();
+    bool write_config();
+    int write_index_chunk();
+    int write_trailer();
+    // takes output_mtx
+    int write_block(const unsigned char* buf, size_t buf_sz,
+                    const ygor_series_logger* ysl,
+                    uint64_t count, uint64_t min, uint64_t max,
+                    const block_summary& summary);
 
     po6::threads::mutex output_mtx;
+    // the output is written through either stdio or, when preallocating in
+    // extents of preallocate bytes, as a direct_output
     FILE* output;
+    direct_output* direct;
+    uint64_t preallocate;
+    // when set, direct output's blocks are written through io_uring
+    uring_writer* uring;
+    // with segment rollover, output is the current one of a sequence of
+    // complete files named output_name.0000, output_name.0001, and so on
+    std::string output_name;
+    bool segmented;
+    unsigned segment;
+    uint64_t segment_bytes;
+    uint64_t segment_interval;
+    uint64_t segment_start;
+    // the offset at which the next block will be written, and the index
+    // entries not yet written to the file
+    uint64_t output_offset;
+    std::vector<index_entry> index;
+    uint64_t index_prev_chunk;
     const ygor_series** series;
     size_t series_sz;
+    // number of points in a full block
+    size_t block_size;
+    // blocks are carved BLOCKS_PER_SLAB at a time from slabs that live as
+    // long as the logger, and kept on free_blocks while unused
+    po6::threads::mutex pool_mtx;
+    std::vector<ygor_data_point*> slabs;
+    std::vector<ygor_data_point*> free_blocks;
     e::ao_hash_map<const ygor_series*, ygor_series_logger*, hash_ptr, (ygor_series*)NULL> series_loggers;
+    // the same loggers indexed by position in series; a ygor_series_handle is
+    // an index into this array
+    ygor_series_logger** series_loggers_by_handle;
+    // thread-local buffers are registered here so that they may be flushed by
+    // flush_and_destroy; the key is only valid when thread_local_buffers is set
+    bool thread_local_buffers;
+    pthread_key_t thread_buffers_key;
+    po6::threads::mutex thread_buffers_mtx;
+    std::list<thread_buffers*> thread_buffers_list;
+    bool thread_buffers_failed;
+    // when there is a background writer, full blocks are queued here and the
+    // writer thread sorts, packs, and writes them, returning each block to
+    // the free list so that recording never waits on I/O
+    po6::threads::mutex writer_mtx;
+    po6::threads::cond writer_cond;
+    po6::threads::cond writer_drained;
+    po6::threads::cond block_freed;
+    po6::threads::thread* writer_thread;
+    int writer_cpu;
+    std::list<pending_block> writer_queue;
+    // once queue_limit blocks (from the memory budget) are queued or being
+    // written, the overload policy applies
+    size_t queue_limit;
+    bool writer_busy;
+    bool writer_shutdown;
+    bool writer_failed;
+    // with a flush interval, this thread flushes the logger every interval
+    // until flush_and_destroy
+    po6::threads::mutex flusher_mtx;
+    po6::threads::cond flusher_cond;
+    po6::threads::thread* flusher_thread;
+    uint64_t flush_interval;
+    bool flusher_shutdown;
+    bool flusher_failed;
+    // with the drop policy, points dropped since they were last recorded in
+    // the dropped series (the last of series)
+    bool drop_on_overload;
+    po6::threads::mutex dropped_mtx;
+    uint64_t dropped;
+    // calibrated when any series is recorded in cycles
+    uint64_t cycles_per_second;
 
     private:
         ygor_data_logger(const ygor_data_logger&);
         ygor_data_logger& operator = (const ygor_data_logger&);
 };
 
-YGOR_API ygor_data_logger*
-ygor_data_logger_create(const char* output,
-                        const ygor_series** series,
-                        size_t series_sz)
+static void
+ygor_data_logger_writer(ygor_data_logger* ydl)
 {
-    ygor_data_logger* ydl = new ygor_data_logger();
+    ydl->writer();
+}
 
-    if (!ydl->init(output, series, series_sz))
-    {
-        delete ydl;
-        return NULL;
-    }
+static void
+ygor_data_logger_flusher(ygor_data_logger* ydl)
+{
+    ydl->flusher();
+}
 
-    return ydl;
+YGOR_API ygor_data_logger_config*
+ygor_data_logger_config_create()
+{
+    return new ygor_data_logger_config();
+}
+
+YGOR_API void
+ygor_data_logger_config_destroy(ygor_data_logger_config* ydlc)
+{
+    delete ydlc;
 }
 
 YGOR_API int
-ygor_data_logger_flush_and_destroy(ygor_data_logger* ydl)
+ygor_data_logger_config_thread_local_buffers(ygor_data_logger_config* ydlc, int enable)
 {
-    bool success = true;
+    ydlc->thread_local_buffers = enable != 0;
+    return 0;
+}
 
-    for (size_t i = 0; i < ydl->series_sz; ++i)
-    {
-        ygor_series_logger* ysl = ydl->get_series_logger(ydl->series[i]);
+YGOR_API int
+ygor_data_logger_config_background_writer(ygor_data_logger_config* ydlc, int enable)
+{
+    ydlc->background_writer = enable != 0;
+    return 0;
+}
 
-        if (!ysl || ysl->flush() < 0)
-        {
-            success = false;
-        }
+YGOR_API int
+ygor_data_logger_config_writer_cpu(ygor_data_logger_config* ydlc, int cpu)
+{
+    if (cpu < -1 || cpu >= CPU_SETSIZE)
+    {
+        errno = EINVAL;
+        return -1;
     }
 
-    ydl->output_mtx.lock();
-    int x = fflush(ydl->output);
-    int y = fclose(ydl->output);
-    ydl->output_mtx.unlock();
-    delete ydl;
+    ydlc->writer_cpu = cpu;
+    return 0;
+}
 
-    if (!success || x != 0 || y != 0)
+YGOR_API int
+ygor_data_logger_config_block_size(ygor_data_logger_config* ydlc, size_t points)
+{
+    if (points == 0 || points > MAX_SERIES_BUFFER_SIZE)
     {
+        errno = EINVAL;
         return -1;
     }
 
+    ydlc->block_size = points;
     return 0;
 }
 
 YGOR_API int
-ygor_data_logger_record(ygor_data_logger* ydl, ygor_data_point* ydp)
+ygor_data_logger_config_flush_interval(ygor_data_logger_config* ydlc, uint64_t millis)
 {
-    ygor_series_logger* ysl = ydl->get_series_logger(ydp->series);
-
-    if (!ysl)
+    if (millis > UINT64_MAX / PO6_MILLIS)
     {
+        errno = EINVAL;
         return -1;
     }
 
-    return ysl->record(ydp);
+    ydlc->flush_interval = millis * PO6_MILLIS;
+    return 0;
 }
 
-ygor_data_logger :: ygor_data_logger()
-    : output_mtx()
-    , output(NULL)
-    , series(NULL)
-    , series_sz(0)
-    , series_loggers()
+YGOR_API int
+ygor_data_logger_config_segment_bytes(ygor_data_logger_config* ydlc, uint64_t bytes)
 {
+    ydlc->segment_bytes = bytes;
+    return 0;
 }
 
-ygor_data_logger :: ~ygor_data_logger() throw ()
+YGOR_API int
+ygor_data_logger_config_segment_interval(ygor_data_logger_config* ydlc, uint64_t millis)
 {
-    for (size_t i = 0; i < series_sz; ++i)
+    if (millis > UINT64_MAX / PO6_MILLIS)
     {
-        delete get_series_logger(series[i]);
+        errno = EINVAL;
+        return -1;
     }
 
-    delete[] series;
-    // do not touch output because we only delete ydl from flush_and_destroy,
-    // and it would be an error to double fclose it.
+    ydlc->segment_interval = millis * PO6_MILLIS;
+    return 0;
 }
 
-bool
-ygor_data_logger :: init(const char* output_name,
-                         const ygor_series** s, size_t s_sz)
+YGOR_API int
+ygor_data_logger_config_preallocate(ygor_data_logger_config* ydlc, uint64_t extent)
 {
-    series = new const ygor_series*[s_sz];
+    ydlc->preallocate = extent;
+    return 0;
+}
 
-    for (size_t i = 0; i < s_sz; ++i)
-    {
-        series[i] = s[i];
-    }
+YGOR_API int
+ygor_data_logger_config_io_uring(ygor_data_logger_config* ydlc, int enable)
+{
+    ydlc->io_uring = enable != 0;
+    return 0;
+}
 
-    series_sz = s_sz;
-    po6::threads::mutex::hold hold(&output_mtx);
-    output = fopen(output_name, "w");
+YGOR_API int
+ygor_data_logger_config_memory_budget(ygor_data_logger_config* ydlc, uint64_t bytes)
+{
+    ydlc->memory_budget = bytes;
+    return 0;
+}
 
-    for (size_t i = 0; i < s_sz; ++i)
+YGOR_API int
+ygor_data_logger_config_overload_policy(ygor_data_logger_config* ydlc, ygor_overload_policy policy)
+{
+    if (policy != YGOR_OVERLOAD_BLOCK && policy != YGOR_OVERLOAD_DROP)
     {
-        ygor_series_logger* ysl = new ygor_series_logger(this, series[i]);
-
-        if (!series_loggers.put(series[i], ysl))
-        {
-            return false;
-        }
-
-        size_t name_len = strlen(series[i]->name);
-
-        if (name_len > 64 ||
-            fwrite(series[i]->name, 1, name_len + 1, output) != name_len + 1)
-        {
-            return false;
-        }
+        errno = EINVAL;
+        return -1;
+    }
 
-        unsigned char buf[4];
-        buf[0] = series[i]->indep_units;
-        buf[1] = series[i]->indep_precision;
-        buf[2] = series[i]->dep_units;
-        buf[3] = series[i]->dep_precision;
+    ydlc->overload_policy = policy;
+    return 0;
+}
 
-        if (fwrite(buf, 1, 4, output) != 4)
-        {
-            return false;
-        }
-    }
+YGOR_API int
+ygor_data_logger_config_cycles_per_second(ygor_data_logger_config* ydlc, uint64_t rate)
+{
+    ydlc->cycles_per_second = rate;
+    return 0;
+}
 
-    if (fwrite("\x00", 1, 1, output) != 1)
+YGOR_API int
+ygor_data_logger_config_series_encoding(ygor_data_logger_config* ydlc,
+                                        const ygor_series* series,
+                                        unsigned encoding)
+{
+    if ((encoding & ~KNOWN_ENCODINGS) ||
+        ((encoding & YGOR_ENCODING_DELTA_OF_DELTA) &&
+         series->indep_precision != YGOR_PRECISE_INTEGER) ||
+        ((encoding & YGOR_ENCODING_XOR) &&
+         series->dep_precision != YGOR_SINGLE_PRECISION &&
+         series->dep_precision != YGOR_DOUBLE_PRECISION) ||
+        (encoding && ydlc->options(series)->histogram_interval))
     {
-        return false;
+        errno = EINVAL;
+        return -1;
     }
 
-    return true;
+    ydlc->options(series)->encoding = encoding;
+    return 0;
 }
 
-size_t
-ygor_data_logger :: series_index(const ygor_series* s)
+YGOR_API int
+ygor_data_logger_config_series_histogram(ygor_data_logger_config* ydlc,
+                                         const ygor_series* series,
+                                         uint64_t interval, unsigned precision)
 {
-    for (size_t i = 0; i < series_sz; ++i)
+    if (interval == 0 ||
+        precision < 1 || precision > HISTOGRAM_MAX_PRECISION ||
+        series->indep_precision != YGOR_PRECISE_INTEGER ||
+        series->dep_precision != YGOR_PRECISE_INTEGER ||
+        ydlc->options(series)->sampling ||
+        ydlc->options(series)->encoding)
     {
-        if (series[i] == s)
-        {
-            return i;
-        }
+        errno = EINVAL;
+        return -1;
     }
 
-    return series_sz;
+    series_options* so = ydlc->options(series);
+    so->histogram_interval = interval;
+    so->histogram_precision = precision;
+    return 0;
 }
 
-ygor_series_logger*
-ygor_data_logger :: get_series_logger(const ygor_series* s)
+YGOR_API int
+ygor_data_logger_config_series_sampling(ygor_data_logger_config* ydlc,
+                                        const ygor_series* series,
+                                        ygor_sampling sampling,
+                                        uint64_t n, uint64_t interval)
 {
-    ygor_series_logger* ysl = NULL;
-    return series_loggers.get(s, &ysl) ? ysl : NULL;
-}
+    if ((sampling != YGOR_SAMPLING_ONE_IN_N &&
+         sampling != YGOR_SAMPLING_RESERVOIR &&
+         sampling != YGOR_SAMPLING_THROTTLE) ||
+        n == 0 || n > UINT32_MAX ||
+        (sampling == YGOR_SAMPLING_THROTTLE &&
+         (interval == 0 || series->indep_precision != YGOR_PRECISE_INTEGER)) ||
+        ydlc->options(series)->histogram_interval)
+    {
+        errno = EINVAL;
+        return -1;
+    }
 
-bool
-sort_func_precise(const ygor_data_point& lhs, const ygor_data_point& rhs)
-{
-    return lhs.indep.precise < rhs.indep.precise;
+    series_options* so = ydlc->options(series);
+    so->sampling = sampling;
+    so->sampling_n = n;
+    so->sampling_interval = sampling == YGOR_SAMPLING_THROTTLE ? interval : 0;
+    return 0;
 }
 
-bool
-sort_func_approximate(const ygor_data_point& lhs, const ygor_data_point& rhs)
+YGOR_API ygor_data_logger*
+ygor_data_logger_create(const char* output,
+                        const ygor_series** series,
+                        size_t series_sz)
 {
-    return lhs.indep.approximate < rhs.indep.approximate;
+    ygor_data_logger_config ydlc;
+    return ygor_data_logger_create_with_config(output, series, series_sz, &ydlc);
 }
 
-sort_func_t
-ygor_series_logger :: sort_func(const ygor_series* s)
+YGOR_API ygor_data_logger*
+ygor_data_logger_create_with_config(const char* output,
+                                    const ygor_series** series,
+                                    size_t series_sz,
+                                    const ygor_data_logger_config* ydlc)
 {
-    switch (s->indep_precision)
+    ygor_data_logger* ydl = new ygor_data_logger();
+
+    if (!ydl->init(output, series, series_sz, ydlc))
     {
-        case YGOR_PRECISE_INTEGER: return sort_func_precise;
-        case YGOR_HALF_PRECISION: return sort_func_approximate;
-        case YGOR_SINGLE_PRECISION: return sort_func_approximate;
-        case YGOR_DOUBLE_PRECISION: return sort_func_approximate;
-        default: return NULL;
+        delete ydl;
+        return NULL;
     }
-}
-
-template <ygor_precision P>
-unsigned char* pack_value_templ(const ygor_data_value& v, unsigned char* out);
 
-template <>
-unsigned char*
-pack_value_templ<YGOR_PRECISE_INTEGER>(const ygor_data_value& v, unsigned char* out)
-{
-    return e::packvarint64(v.precise, out);
+    return ydl;
 }
 
-template <>
-unsigned char*
-pack_value_templ<YGOR_HALF_PRECISION>(const ygor_data_value& v, unsigned char* out)
+YGOR_API int
+ygor_data_logger_flush(ygor_data_logger* ydl)
 {
-    uint16_t h = halffloat_compress(v.approximate);
-    return e::pack16be(h, out);
+    return ydl->flush();
 }
 
-template <>
-unsigned char*
-pack_value_templ<YGOR_SINGLE_PRECISION>(const ygor_data_value& v, unsigned char* out)
+YGOR_API int
+ygor_data_logger_flush_and_destroy(ygor_data_logger* ydl)
 {
-    return e::packfloatbe(v.approximate, out);
-}
+    bool success = ydl->stop_flusher() >= 0;
 
-template <>
-unsigned char*
-pack_value_templ<YGOR_DOUBLE_PRECISION>(const ygor_data_value& v, unsigned char* out)
-{
-    return e::packdoublebe(v.approximate, out);
-}
-
-template <ygor_precision I, ygor_precision D>
-unsigned char*
-pack_func_templ(const ygor_data_point*, ygor_data_point* point, unsigned char* out)
-{
-    out = pack_value_templ<I>(point->indep, out);
-    return pack_value_templ<D>(point->dep, out);
-}
-
-unsigned char*
-pack_func_ipi(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
-{
-    if (prev)
+    if (ydl->flush() < 0)
     {
-        assert(prev->indep.precise <= point->indep.precise);
-        return e::packvarint64(point->indep.precise - prev->indep.precise, out);
+        success = false;
     }
-    else
+
+    if (ydl->stop_writer() < 0)
     {
-        return e::packvarint64(point->indep.precise, out);
+        success = false;
     }
-}
 
-unsigned char*
-pack_func_pi_pi(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
-{
-    out = pack_func_ipi(prev, point, out);
-    return pack_value_templ<YGOR_PRECISE_INTEGER>(point->dep, out);
-}
+    if (ydl->uring && ydl->uring->drain() < 0)
+    {
+        success = false;
+    }
 
-unsigned char*
-pack_func_pi_hp(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
-{
-    out = pack_func_ipi(prev, point, out);
-    return pack_value_templ<YGOR_HALF_PRECISION>(point->dep, out);
-}
+    ydl->output_mtx.lock();
 
-unsigned char*
-pack_func_pi_sp(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
-{
-    out = pack_func_ipi(prev, point, out);
-    return pack_value_templ<YGOR_SINGLE_PRECISION>(point->dep, out);
-}
+    if (ydl->close_output() < 0)
+    {
+        success = false;
+    }
 
-unsigned char*
-pack_func_pi_dp(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
-{
-    out = pack_func_ipi(prev, point, out);
-    return pack_value_templ<YGOR_DOUBLE_PRECISION>(point->dep, out);
+    ydl->output_mtx.unlock();
+    delete ydl;
+    return success ? 0 : -1;
 }
 
-pack_func_t
-pack_func_precise_integer(const ygor_series* s)
+static int
+ygor_data_logger_record_to(ygor_data_logger* ydl, ygor_series_logger* ysl, ygor_data_point* ydp)
 {
-    switch (s->dep_precision)
+    if (!ysl->sample(ydp->indep))
     {
-        case YGOR_PRECISE_INTEGER: return pack_func_pi_pi;
-        case YGOR_HALF_PRECISION: return pack_func_pi_hp;
-        case YGOR_SINGLE_PRECISION: return pack_func_pi_sp;
-        case YGOR_DOUBLE_PRECISION: return pack_func_pi_dp;
-        default: return NULL;
+        return 0;
     }
-}
 
-pack_func_t
-pack_func_half_precision(const ygor_series* s)
-{
-    switch (s->dep_precision)
+    if (ydl->thread_local_buffers)
     {
-        case YGOR_PRECISE_INTEGER: return pack_func_templ<YGOR_HALF_PRECISION, YGOR_PRECISE_INTEGER>;
-        case YGOR_HALF_PRECISION: return pack_func_templ<YGOR_HALF_PRECISION, YGOR_HALF_PRECISION>;
-        case YGOR_SINGLE_PRECISION: return pack_func_templ<YGOR_HALF_PRECISION, YGOR_SINGLE_PRECISION>;
-        case YGOR_DOUBLE_PRECISION: return pack_func_templ<YGOR_HALF_PRECISION, YGOR_DOUBLE_PRECISION>;
-        default: return NULL;
+        thread_buffers* tb = ydl->get_thread_buffers();
+        return tb ? tb->record(ysl, ydp) : -1;
     }
+
+    return ysl->record(ydp);
 }
 
-pack_func_t
-pack_func_single_precision(const ygor_series* s)
+YGOR_API int
+ygor_data_logger_record(ygor_data_logger* ydl, ygor_data_point* ydp)
 {
-    switch (s->dep_precision)
+    ygor_series_logger* ysl = ydl->get_series_logger(ydp->series);
+
+    if (!ysl)
     {
-        case YGOR_PRECISE_INTEGER: return pack_func_templ<YGOR_SINGLE_PRECISION, YGOR_PRECISE_INTEGER>;
-        case YGOR_HALF_PRECISION: return pack_func_templ<YGOR_SINGLE_PRECISION, YGOR_HALF_PRECISION>;
-        case YGOR_SINGLE_PRECISION: return pack_func_templ<YGOR_SINGLE_PRECISION, YGOR_SINGLE_PRECISION>;
-        case YGOR_DOUBLE_PRECISION: return pack_func_templ<YGOR_SINGLE_PRECISION, YGOR_DOUBLE_PRECISION>;
-        default: return NULL;
+        return -1;
     }
+
+    return ygor_data_logger_record_to(ydl, ysl, ydp);
 }
 
-pack_func_t
-pack_func_double_precision(const ygor_series* s)
+YGOR_API int
+ygor_data_logger_series_handle(ygor_data_logger* ydl, const ygor_series* series,
+                               ygor_series_handle* h)
 {
-    switch (s->dep_precision)
+    size_t idx = ydl->series_index(series);
+
+    if (idx >= ydl->series_sz)
     {
-        case YGOR_PRECISE_INTEGER: return pack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_PRECISE_INTEGER>;
-        case YGOR_HALF_PRECISION: return pack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_HALF_PRECISION>;
-        case YGOR_SINGLE_PRECISION: return pack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_SINGLE_PRECISION>;
-        case YGOR_DOUBLE_PRECISION: return pack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_DOUBLE_PRECISION>;
-        default: return NULL;
+        errno = EINVAL;
+        return -1;
     }
+
+    *h = idx;
+    return 0;
 }
 
-pack_func_t
-ygor_series_logger :: pack_func(const ygor_series* s)
+YGOR_API int
+ygor_data_logger_record_h(ygor_data_logger* ydl, ygor_series_handle h,
+                          ygor_data_value indep, ygor_data_value dep)
 {
-    switch (s->indep_precision)
+    ygor_series_logger* ysl = ydl->get_series_logger(h);
+
+    if (!ysl)
     {
-        case YGOR_PRECISE_INTEGER: return pack_func_precise_integer(s);
-        case YGOR_HALF_PRECISION: return pack_func_half_precision(s);
-        case YGOR_SINGLE_PRECISION: return pack_func_single_precision(s);
-        case YGOR_DOUBLE_PRECISION: return pack_func_double_precision(s);
-        default: return NULL;
+        return -1;
     }
-}
-
-ygor_series_logger :: ygor_series_logger(ygor_data_logger* dl, const ygor_series* s)
-    : ydl(dl)
-    , ys(s)
-    , sindex(ydl->series_index(ys))
-    , points_mtx()
-    , points(points_A)
-    , points_sz(0)
-    , io_mtx()
-    , sort(sort_func(ys))
-    , pack(pack_func(ys))
-{
-}
 
-ygor_series_logger :: ~ygor_series_logger() throw ()
-{
+    ygor_data_point ydp;
+    ydp.series = ysl->ys;
+    ydp.indep = indep;
+    ydp.dep = dep;
+    return ygor_data_logger_record_to(ydl, ysl, &ydp);
 }
 
-int
-ygor_series_logger :: record(ygor_data_point* ydp)
+YGOR_API int
+ygor_data_logger_record_batch(ygor_data_logger* ydl, const ygor_data_point* ydp, size_t ydp_sz)
 {
-    points_mtx.lock();
-    assert(points_sz < SERIES_BUFFER_SIZE);
-    points[points_sz] = *ydp;
-    ++points_sz;
+    thread_buffers* tb = NULL;
 
-    if (points_sz < SERIES_BUFFER_SIZE)
+    if (ydl->thread_local_buffers && !(tb = ydl->get_thread_buffers()))
     {
-        points_mtx.unlock();
-        return 0;
+        return -1;
     }
 
-    po6::threads::mutex::hold hold(&io_mtx);
-    ygor_data_point* flush = points;
-    points = points == points_A ? points_B : points_A;
-    points_sz = 0;
-    points_mtx.unlock();
-    return write(flush, SERIES_BUFFER_SIZE);
-}
+    int ret = 0;
+    size_t i = 0;
+
+    while (i < ydp_sz)
+    {
+        // look up and lock each run of points for the same series just once
+        size_t j = i + 1;
+
+        while (j < ydp_sz && ydp[j].series == ydp[i].series)
+        {
+            ++j;
+        }
+
+        ygor_series_logger* ysl = ydl->get_series_logger(ydp[i].series);
+
+        if (!ysl)
+        {
+            return -1;
+        }
+
+        // sampled series filter each point before it is buffered
+        if (ysl->sampling)
+        {
+            for (; i < j; ++i)
+            {
+                ygor_data_point p = ydp[i];
+
+                if (ygor_data_logger_record_to(ydl, ysl, &p) < 0)
+                {
+                    ret = -1;
+                }
+            }
+
+            continue;
+        }
+
+        point_batch batch(ydp + i);
+
+        if ((tb ? tb->record_batch(ysl, batch, j - i)
+                : ysl->record_batch(batch, j - i)) < 0)
+        {
+            ret = -1;
+        }
+
+        i = j;
+    }
 
-int
-ygor_series_logger :: flush()
-{
-    po6::threads::mutex::hold holdp(&points_mtx);
-    po6::threads::mutex::hold holdi(&io_mtx);
-    int ret = write(points, points_sz);
-    points_sz = 0;
     return ret;
 }
 
-int
-ygor_series_logger :: write(ygor_data_point* flush, size_t flush_sz)
+YGOR_API int
+ygor_data_logger_record_columns(ygor_data_logger* ydl, const ygor_series* series,
+                                const ygor_data_value* indep,
+                                const ygor_data_value* dep, size_t sz)
 {
-    std::sort(flush, flush + flush_sz, sort);
-    unsigned char buf[sizeof(uint64_t) + VARINT_64_MAX_SIZE + SERIES_BUFFER_SIZE * MAX_POINT_SIZE];
-    unsigned char* ptr = buf + sizeof(uint64_t);
-    ptr = e::packvarint64(sindex, ptr);
+    ygor_series_logger* ysl = ydl->get_series_logger(series);
 
-    for (size_t i = 0; i < flush_sz; ++i)
+    if (!ysl)
     {
-        ptr = pack(i > 0 ? flush + i - 1 : NULL, flush + i, ptr);
+        return -1;
     }
 
-    size_t buf_sz = ptr - buf;
-    e::pack64be(buf_sz - sizeof(uint64_t), buf);
-    po6::threads::mutex::hold hold(&ydl->output_mtx);
-    return fwrite(buf, 1, buf_sz, ydl->output) == buf_sz ? 0 : -1;
-}
-
-struct ygor_data_reader
-{
-    ygor_data_reader();
-    ~ygor_data_reader() throw ();
+    if (ysl->sampling)
+    {
+        int ret = 0;
 
-    bool init(const char* input);
+        for (size_t i = 0; i < sz; ++i)
+        {
+            ygor_data_point p;
+            p.series = series;
+            p.indep = indep[i];
+            p.dep = dep[i];
 
-    std::string input;
-    off_t data_offset;
-    std::vector<ygor_series> series;
-    std::list<std::string> names;
+            if (ygor_data_logger_record_to(ydl, ysl, &p) < 0)
+            {
+                ret = -1;
+            }
+        }
 
-    private:
-        ygor_data_reader(const ygor_data_reader&);
-        ygor_data_reader& operator = (const ygor_data_reader&);
-};
+        return ret;
+    }
 
-YGOR_API ygor_data_reader*
-ygor_data_reader_create(const char* input)
-{
-    ygor_data_reader* ydr = new ygor_data_reader();
+    column_batch batch(series, indep, dep);
 
-    if (!ydr->init(input))
+    if (ydl->thread_local_buffers)
     {
-        delete ydr;
-        return NULL;
+        thread_buffers* tb = ydl->get_thread_buffers();
+        return tb ? tb->record_batch(ysl, batch, sz) : -1;
     }
 
-    return ydr;
+    return ysl->record_batch(batch, sz);
 }
 
-YGOR_API void
-ygor_data_reader_destroy(ygor_data_reader* ydr)
+series_options :: series_options()
+    : series(NULL)
+    , encoding(0)
+    , histogram_interval(0)
+    , histogram_precision(0)
+    , sampling(0)
+    , sampling_n(0)
+    , sampling_interval(0)
 {
-    delete ydr;
 }
 
-YGOR_API size_t
-ygor_data_reader_num_series(ygor_data_reader* ydr)
+series_options :: series_options(const ygor_series* s)
+    : series(s)
+    , encoding(0)
+    , histogram_interval(0)
+    , histogram_precision(0)
+    , sampling(0)
+    , sampling_n(0)
+    , sampling_interval(0)
 {
-    return ydr->series.size();
 }
 
-YGOR_API const ygor_series*
-ygor_data_reader_series(ygor_data_reader* ydr, size_t idx)
+point_batch :: point_batch(const ygor_data_point* ydp)
+    : points(ydp)
 {
-    return &ydr->series[idx];
 }
 
-ygor_data_reader :: ygor_data_reader()
-    : input()
-    , data_offset(0)
-    , series()
-    , names()
+void
+point_batch :: copy(size_t off, size_t n, ygor_data_point* out) const
 {
+    memcpy(out, points + off, n * sizeof(ygor_data_point));
 }
 
-ygor_data_reader :: ~ygor_data_reader() throw ()
+column_batch :: column_batch(const ygor_series* s,
+                             const ygor_data_value* i,
+                             const ygor_data_value* d)
+    : series(s)
+    , indep(i)
+    , dep(d)
 {
 }
 
-bool
-ygor_data_reader :: init(const char* name)
+void
+column_batch :: copy(size_t off, size_t n, ygor_data_point* out) const
 {
-    input = name;
-    FILE* fin = fopen(name, "r");
-
-    if (!fin)
+    for (size_t i = 0; i < n; ++i)
     {
-        return false;
+        out[i].series = series;
+        out[i].indep = indep[off + i];
+        out[i].dep = dep[off + i];
     }
+}
 
-    e::guard g_fin = e::makeguard(fclose, fin);
-    char buffer[512];
-    size_t used = 0;
+ygor_data_logger_config :: ygor_data_logger_config()
+    : thread_local_buffers(false)
+    , background_writer(false)
+    , writer_cpu(-1)
+    , block_size(SERIES_BUFFER_SIZE)
+    , flush_interval(0)
+    , segment_bytes(0)
+    , segment_interval(0)
+    , preallocate(0)
+    , io_uring(false)
+    , memory_budget(0)
+    , overload_policy(YGOR_OVERLOAD_BLOCK)
+    , cycles_per_second(0)
+    , per_series()
+{
+}
 
-    while (true)
-    {
-        char* ptr = (char*)memchr(buffer, '\0', used);
+ygor_data_logger_config :: ~ygor_data_logger_config() throw ()
+{
+}
 
-        if (!ptr && feof(fin))
+series_options
+ygor_data_logger_config :: options(const ygor_series* s) const
+{
+    for (size_t i = 0; i < per_series.size(); ++i)
+    {
+        if (per_series[i].series == s)
         {
-            return false;
+            return per_series[i];
         }
-        else if (!ptr)
-        {
-            size_t amt = fread(buffer + used, 1, 512 - used, fin);
+    }
 
-            if (amt == 0 || ferror(fin))
-            {
-                return false;
-            }
+    return series_options(s);
+}
 
-            used += amt;
+series_options*
+ygor_data_logger_config :: options(const ygor_series* s)
+{
+    for (size_t i = 0; i < per_series.size(); ++i)
+    {
+        if (per_series[i].series == s)
+        {
+            return &per_series[i];
+        }
+    }
+
+    per_series.push_back(series_options(s));
+    return &per_series.back();
+}
+
+pending_block :: pending_block()
+    : ysl(NULL)
+    , points(NULL)
+    , points_sz(0)
+{
+}
+
+pending_block :: pending_block(ygor_series_logger* l, ygor_data_point* p, size_t p_sz)
+    : ysl(l)
+    , points(p)
+    , points_sz(p_sz)
+{
+}
+
+direct_output :: direct_output(int f)
+    : fd(f)
+    , allocated(0)
+    , pending(0)
+    , retired(false)
+    , size(0)
+{
+}
+
+direct_output :: ~direct_output() throw ()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+void
+direct_output :: reserve(uint64_t end, uint64_t extent)
+{
+    while (extent > 0 && allocated < end)
+    {
+        // preallocation is only an optimization; pwrite extends the file
+        // when the file system cannot
+        if (posix_fallocate(fd, allocated, extent) != 0)
+        {
+            allocated = UINT64_MAX;
+            break;
+        }
+
+        allocated += extent;
+    }
+}
+
+int
+direct_output :: write_at(const unsigned char* buf, size_t buf_sz, uint64_t offset)
+{
+    while (buf_sz > 0)
+    {
+        ssize_t amt = pwrite(fd, buf, buf_sz, offset);
+
+        if (amt < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (amt <= 0)
+        {
+            return -1;
+        }
+
+        buf += amt;
+        buf_sz -= amt;
+        offset += amt;
+    }
+
+    return 0;
+}
+
+// drop what remains of the last extent, and close the file
+int
+direct_output :: finish()
+{
+    int ret = ftruncate(fd, size) == 0 ? 0 : -1;
+
+    if (close(fd) != 0)
+    {
+        ret = -1;
+    }
+
+    fd = -1;
+    return ret;
+}
+
+uring_writer :: uring_writer(ygor_data_logger* dl)
+    : ydl(dl)
+    , mtx()
+#ifdef HAVE_LIBURING
+    , ring()
+#endif
+    , ring_ready(false)
+    , buffer_sz(0)
+    , buffers()
+    , free_buffers()
+    , targets()
+    , sizes()
+    , offsets()
+    , in_flight(0)
+    , failed(false)
+{
+}
+
+uring_writer :: ~uring_writer() throw ()
+{
+#ifdef HAVE_LIBURING
+    if (ring_ready)
+    {
+        io_uring_queue_exit(&ring);
+    }
+#endif
+
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        delete[] buffers[i];
+    }
+}
+
+#ifdef HAVE_LIBURING
+bool
+uring_writer :: init(unsigned depth, size_t sz)
+{
+    if (io_uring_queue_init(depth, &ring, 0) < 0)
+    {
+        return false;
+    }
+
+    ring_ready = true;
+    buffer_sz = sz;
+    std::vector<iovec> iov(depth);
+
+    for (size_t i = 0; i < depth; ++i)
+    {
+        buffers.push_back(new unsigned char[sz]);
+        free_buffers.push_back(i);
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = sz;
+    }
+
+    targets.resize(depth, NULL);
+    sizes.resize(depth, 0);
+    offsets.resize(depth, 0);
+    return io_uring_register_buffers(&ring, &iov[0], depth) == 0;
+}
+
+bool
+uring_writer :: submit(direct_output* d, const unsigned char* buf, size_t buf_sz, uint64_t offset)
+{
+    po6::threads::mutex::hold hold(&mtx);
+
+    if (buf_sz > buffer_sz)
+    {
+        return false;
+    }
+
+    reap(false);
+
+    while (free_buffers.empty())
+    {
+        if (!reap(true))
+        {
+            return false;
+        }
+    }
+
+    // there are as many entries in the submission queue as buffers
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+
+    if (!sqe)
+    {
+        return false;
+    }
+
+    const size_t idx = free_buffers.back();
+    free_buffers.pop_back();
+    memmove(buffers[idx], buf, buf_sz);
+    targets[idx] = d;
+    sizes[idx] = buf_sz;
+    offsets[idx] = offset;
+    io_uring_prep_write_fixed(sqe, d->fd, buffers[idx], buf_sz, offset, idx);
+    io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(uintptr_t(idx)));
+    ++in_flight;
+    int ret;
+
+    while ((ret = io_uring_submit(&ring)) == -EINTR)
+    {
+    }
+
+    // The write never reached the kernel.  Its entry stays in the ring, to go
+    // out with the next submission, so it becomes a no-op that reap ignores,
+    // and the block goes back to the caller to write with pwrite.
+    if (ret < 0)
+    {
+        io_uring_prep_nop(sqe);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(uintptr_t(buffers.size())));
+        targets[idx] = NULL;
+        free_buffers.push_back(idx);
+        --in_flight;
+        return false;
+    }
+
+    return true;
+}
+
+int
+uring_writer :: drain()
+{
+    po6::threads::mutex::hold hold(&mtx);
+
+    while (in_flight > 0 && reap(true))
+    {
+    }
+
+    const bool ok = in_flight == 0 && !failed;
+    failed = false;
+    return ok ? 0 : -1;
+}
+
+// Handle every completed write, first waiting for one if wait is set.  False
+// if waiting failed.
+bool
+uring_writer :: reap(bool wait)
+{
+    io_uring_cqe* cqe = NULL;
+    int ret;
+
+    do
+    {
+        ret = wait ? io_uring_wait_cqe(&ring, &cqe)
+                   : io_uring_peek_cqe(&ring, &cqe);
+    } while (wait && ret == -EINTR);
+
+    if (wait && ret < 0)
+    {
+        failed = true;
+        return false;
+    }
+
+    while (ret == 0)
+    {
+        const size_t idx = reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe));
+        const int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+
+        // the no-op left by a failed submission
+        if (idx < buffers.size())
+        {
+            complete(idx, res);
+        }
+
+        ret = io_uring_peek_cqe(&ring, &cqe);
+    }
+
+    return true;
+}
+
+void
+uring_writer :: complete(size_t idx, int res)
+{
+    direct_output* d = targets[idx];
+
+    // finish a short write synchronously
+    if (res < 0 ||
+        (size_t(res) < sizes[idx] &&
+         d->write_at(buffers[idx] + res, sizes[idx] - res, offsets[idx] + res) < 0))
+    {
+        failed = true;
+    }
+
+    targets[idx] = NULL;
+    free_buffers.push_back(idx);
+    --in_flight;
+    po6::threads::mutex::hold hold(&ydl->output_mtx);
+
+    if (ydl->release_direct(d) < 0)
+    {
+        failed = true;
+    }
+}
+#else
+bool
+uring_writer :: init(unsigned, size_t)
+{
+    return false;
+}
+
+bool
+uring_writer :: submit(direct_output*, const unsigned char*, size_t, uint64_t)
+{
+    return false;
+}
+
+int
+uring_writer :: drain()
+{
+    return 0;
+}
+#endif
+
+static void
+thread_buffers_exit(void* ptr)
+{
+    thread_buffers* tb = static_cast<thread_buffers*>(ptr);
+    tb->ydl->release_thread_buffers(tb);
+}
+
+thread_buffers :: thread_buffers(ygor_data_logger* dl)
+    : ydl(dl)
+    , mtx()
+    , points(dl->series_sz, NULL)
+    , points_sz(dl->series_sz, 0)
+{
+}
+
+thread_buffers :: ~thread_buffers() throw ()
+{
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        if (points[i])
+        {
+            ydl->release_block(points[i]);
+        }
+    }
+}
+
+int
+thread_buffers :: record(ygor_series_logger* ysl, ygor_data_point* ydp)
+{
+    const size_t idx = ysl->sindex;
+    assert(idx < points.size());
+    po6::threads::mutex::hold hold(&mtx);
+
+    if (!points[idx])
+    {
+        points[idx] = ydl->allocate_block();
+    }
+
+    assert(points_sz[idx] < ydl->block_size);
+    points[idx][points_sz[idx]] = *ydp;
+    ++points_sz[idx];
+
+    if (points_sz[idx] < ydl->block_size)
+    {
+        return 0;
+    }
+
+    points_sz[idx] = 0;
+    return ydl->hand_off(ysl, &points[idx], ydl->block_size, true);
+}
+
+template <typename B>
+int
+thread_buffers :: record_batch(ygor_series_logger* ysl, const B& batch, size_t batch_sz)
+{
+    const size_t idx = ysl->sindex;
+    assert(idx < points.size());
+    po6::threads::mutex::hold hold(&mtx);
+    int ret = 0;
+
+    if (!points[idx])
+    {
+        points[idx] = ydl->allocate_block();
+    }
+
+    for (size_t off = 0; off < batch_sz; )
+    {
+        assert(points_sz[idx] < ydl->block_size);
+        const size_t n = std::min(batch_sz - off, ydl->block_size - points_sz[idx]);
+        batch.copy(off, n, points[idx] + points_sz[idx]);
+        points_sz[idx] += n;
+        off += n;
+
+        if (points_sz[idx] == ydl->block_size)
+        {
+            points_sz[idx] = 0;
+
+            if (ydl->hand_off(ysl, &points[idx], ydl->block_size, true) < 0)
+            {
+                ret = -1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+int
+thread_buffers :: flush()
+{
+    po6::threads::mutex::hold hold(&mtx);
+    int ret = 0;
+
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        if (!points[i])
+        {
+            continue;
+        }
+
+        ygor_series_logger* ysl = ydl->series_loggers_by_handle[i];
+
+        if (points_sz[i] > 0 &&
+            (!ysl || ydl->hand_off(ysl, &points[i], points_sz[i], false) < 0))
+        {
+            ret = -1;
+        }
+
+        points_sz[i] = 0;
+        ydl->release_block(points[i]);
+        points[i] = NULL;
+    }
+
+    return ret;
+}
+
+block_summary :: block_summary()
+    : count(0)
+    , indep_sum(0)
+    , indep_sumsq(0)
+    , dep_min(INFINITY)
+    , dep_max(-INFINITY)
+    , dep_sum(0)
+    , dep_sumsq(0)
+{
+}
+
+void
+block_summary :: add(double indep, double dep, uint64_t weight)
+{
+    count += weight;
+    indep_sum += indep * weight;
+    indep_sumsq += indep * indep * weight;
+    dep_min = std::min(dep_min, dep);
+    dep_max = std::max(dep_max, dep);
+    dep_sum += dep * weight;
+    dep_sumsq += dep * dep * weight;
+}
+
+void
+block_summary :: scale(uint64_t weight)
+{
+    count *= weight;
+    indep_sum *= weight;
+    indep_sumsq *= weight;
+    dep_sum *= weight;
+    dep_sumsq *= weight;
+}
+
+void
+block_summary :: add(const block_summary& other)
+{
+    count += other.count;
+    indep_sum += other.indep_sum;
+    indep_sumsq += other.indep_sumsq;
+    dep_min = std::min(dep_min, other.dep_min);
+    dep_max = std::max(dep_max, other.dep_max);
+    dep_sum += other.dep_sum;
+    dep_sumsq += other.dep_sumsq;
+}
+
+index_entry :: index_entry()
+    : series(0)
+    , offset(0)
+    , count(0)
+    , min(0)
+    , max(0)
+    , summary()
+{
+}
+
+index_entry :: index_entry(uint64_t s, uint64_t o, uint64_t c, uint64_t mi, uint64_t ma,
+                           const block_summary& bs)
+    : series(s)
+    , offset(o)
+    , count(c)
+    , min(mi)
+    , max(ma)
+    , summary(bs)
+{
+}
+
+ygor_data_logger :: ygor_data_logger()
+    : output_mtx()
+    , output(NULL)
+    , direct(NULL)
+    , preallocate(0)
+    , uring(NULL)
+    , output_name()
+    , segmented(false)
+    , segment(0)
+    , segment_bytes(0)
+    , segment_interval(0)
+    , segment_start(0)
+    , output_offset(0)
+    , index()
+    , index_prev_chunk(0)
+    , series(NULL)
+    , series_sz(0)
+    , block_size(SERIES_BUFFER_SIZE)
+    , pool_mtx()
+    , slabs()
+    , free_blocks()
+    , series_loggers()
+    , series_loggers_by_handle(NULL)
+    , thread_local_buffers(false)
+    , thread_buffers_key()
+    , thread_buffers_mtx()
+    , thread_buffers_list()
+    , thread_buffers_failed(false)
+    , writer_mtx()
+    , writer_cond(&writer_mtx)
+    , writer_drained(&writer_mtx)
+    , block_freed(&writer_mtx)
+    , writer_thread(NULL)
+    , writer_cpu(-1)
+    , writer_queue()
+    , queue_limit(SIZE_MAX)
+    , writer_busy(false)
+    , writer_shutdown(false)
+    , writer_failed(false)
+    , flusher_mtx()
+    , flusher_cond(&flusher_mtx)
+    , flusher_thread(NULL)
+    , flush_interval(0)
+    , flusher_shutdown(false)
+    , flusher_failed(false)
+    , drop_on_overload(false)
+    , dropped_mtx()
+    , dropped(0)
+    , cycles_per_second(0)
+{
+}
+
+ygor_data_logger :: ~ygor_data_logger() throw ()
+{
+    stop_flusher();
+    stop_writer();
+
+    if (thread_local_buffers)
+    {
+        // delete the key first so no exiting thread races to release its
+        // buffers while they are being deleted here
+        pthread_key_delete(thread_buffers_key);
+
+        for (std::list<thread_buffers*>::iterator it = thread_buffers_list.begin();
+                it != thread_buffers_list.end(); ++it)
+        {
+            delete *it;
+        }
+    }
+
+    if (series_loggers_by_handle)
+    {
+        for (size_t i = 0; i < series_sz; ++i)
+        {
+            delete series_loggers_by_handle[i];
+        }
+    }
+
+    for (size_t i = 0; i < slabs.size(); ++i)
+    {
+        delete[] slabs[i];
+    }
+
+    delete[] series_loggers_by_handle;
+    delete[] series;
+    // do not touch output because we only delete ydl from flush_and_destroy,
+    // and it would be an error to double fclose it.  direct is only left
+    // open when init fails.
+    delete uring;
+    delete direct;
+}
+
+bool
+ygor_data_logger :: init(const char* path,
+                         const ygor_series** s, size_t s_sz,
+                         const ygor_data_logger_config* config)
+{
+    // the drop policy records what it drops in a series of its own
+    drop_on_overload = config->overload_policy == YGOR_OVERLOAD_DROP;
+    series_sz = s_sz + (drop_on_overload ? 1 : 0);
+    series = new const ygor_series*[series_sz];
+
+    for (size_t i = 0; i < s_sz; ++i)
+    {
+        series[i] = s[i];
+    }
+
+    if (drop_on_overload)
+    {
+        series[s_sz] = &dropped_series;
+    }
+
+    block_size = config->block_size;
+    series_loggers_by_handle = new ygor_series_logger*[series_sz]();
+
+    for (size_t i = 0; i < series_sz; ++i)
+    {
+        if (series[i]->indep_units == YGOR_UNIT_CYCLES ||
+            series[i]->dep_units == YGOR_UNIT_CYCLES)
+        {
+            cycles_per_second = config->cycles_per_second
+                              ? config->cycles_per_second
+                              : ygor_clock_cycles_per_second();
+
+            if (cycles_per_second == 0)
+            {
+                errno = ENOTSUP;
+                return false;
+            }
+
+            break;
+        }
+    }
+
+    if (config->memory_budget > 0)
+    {
+        queue_limit = std::max(config->memory_budget / (block_size * sizeof(ygor_data_point)), uint64_t(1));
+    }
+
+    if (config->thread_local_buffers)
+    {
+        if (pthread_key_create(&thread_buffers_key, thread_buffers_exit) != 0)
+        {
+            return false;
+        }
+
+        thread_local_buffers = true;
+    }
+
+    if (config->background_writer)
+    {
+        writer_cpu = config->writer_cpu;
+        writer_thread = new po6::threads::thread(po6::threads::make_func(&ygor_data_logger_writer, this));
+        writer_thread->start();
+    }
+
+    for (size_t i = 0; i < series_sz; ++i)
+    {
+        ygor_series_logger* ysl = new ygor_series_logger(this, series[i], config->options(series[i]));
+        series_loggers_by_handle[i] = ysl;
+
+        if (!series_loggers.put(series[i], ysl))
+        {
+            return false;
+        }
+    }
+
+    po6::threads::mutex::hold hold(&output_mtx);
+    output_name = path;
+    segmented = config->segment_bytes > 0 || config->segment_interval > 0;
+    segment_bytes = config->segment_bytes;
+    segment_interval = config->segment_interval;
+    preallocate = config->preallocate;
+
+    if (config->io_uring)
+    {
+        uring = new uring_writer(this);
+
+        if (!uring->init(URING_DEPTH, sizeof(uint64_t) + 2 * VARINT_64_MAX_SIZE +
+                                      block_size * MAX_POINT_SIZE + 1))
+        {
+            delete uring;
+            uring = NULL;
+        }
+    }
+
+    if (!open_segment())
+    {
+        return false;
+    }
+
+    if (config->flush_interval > 0)
+    {
+        flush_interval = config->flush_interval;
+        flusher_thread = new po6::threads::thread(po6::threads::make_func(&ygor_data_logger_flusher, this));
+        flusher_thread->start();
+    }
+
+    return true;
+}
+
+// Open the file for the current segment and write everything that precedes
+// the first block, so that each segment may be read on its own
+bool
+ygor_data_logger :: open_segment()
+{
+    std::string name(segmented ? segment_name(output_name, segment) : output_name);
+    output_offset = 0;
+    index.clear();
+    index_prev_chunk = 0;
+    segment_start = po6::monotonic_time();
+
+    if (preallocate > 0 || uring)
+    {
+        int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        direct = new direct_output(fd);
+    }
+    else
+    {
+        output = fopen(name.c_str(), "w");
+
+        if (!output)
+        {
+            return false;
+        }
+    }
+
+    return write_header() && write_config();
+}
+
+// Close out the current segment with its trailer and move on to the next
+int
+ygor_data_logger :: roll_segment()
+{
+    int ret = close_output();
+    ++segment;
+
+    if (!open_segment())
+    {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+// Write the trailer and close the output.  Direct output with writes still in
+// flight is closed by the last of them to finish.
+int
+ygor_data_logger :: close_output()
+{
+    if (!output && !direct)
+    {
+        return -1;
+    }
+
+    int ret = write_trailer();
+
+    if (direct)
+    {
+        direct->size = output_offset;
+        direct->retired = true;
+
+        if (direct->pending == 0)
+        {
+            if (direct->finish() < 0)
+            {
+                ret = -1;
+            }
+
+            delete direct;
+        }
+
+        direct = NULL;
+    }
+    else
+    {
+        if (fclose(output) != 0)
+        {
+            ret = -1;
+        }
+
+        output = NULL;
+    }
+
+    return ret;
+}
+
+// call holding output_mtx once a write reserved in d is done
+int
+ygor_data_logger :: release_direct(direct_output* d)
+{
+    assert(d->pending > 0);
+    --d->pending;
+
+    if (!d->retired || d->pending > 0)
+    {
+        return 0;
+    }
+
+    int ret = d->finish();
+    delete d;
+    return ret;
+}
+
+// Write buf at the end of the output, holding output_mtx throughout
+bool
+ygor_data_logger :: append(const unsigned char* buf, size_t buf_sz)
+{
+    const uint64_t offset = output_offset;
+    output_offset += buf_sz;
+
+    if (direct)
+    {
+        direct->reserve(output_offset, preallocate);
+        return direct->write_at(buf, buf_sz, offset) >= 0;
+    }
+
+    return output && fwrite(buf, 1, buf_sz, output) == buf_sz;
+}
+
+bool
+ygor_data_logger :: write_header()
+{
+    std::vector<unsigned char> buf;
+
+    for (size_t i = 0; i < series_sz; ++i)
+    {
+        size_t name_len = strlen(series[i]->name);
+
+        if (name_len > 64)
+        {
+            return false;
+        }
+
+        buf.insert(buf.end(), series[i]->name, series[i]->name + name_len + 1);
+        buf.push_back(series[i]->indep_units);
+        buf.push_back(series[i]->indep_precision);
+        buf.push_back(series[i]->dep_units);
+        buf.push_back(series[i]->dep_precision);
+    }
+
+    buf.push_back(0);
+    return append(&buf[0], buf.size());
+}
+
+bool
+ygor_data_logger :: write_config()
+{
+    std::vector<unsigned char> buf(sizeof(uint64_t) + VARINT_64_MAX_SIZE +
+                                   series_sz * 18 * VARINT_64_MAX_SIZE);
+    unsigned char* ptr = &buf[0] + sizeof(uint64_t);
+    ptr = e::packvarint64(CONFIG_BLOCK, ptr);
+
+    for (size_t i = 0; i < series_sz; ++i)
+    {
+        ptr = e::packvarint64(CONFIG_BLOCK_SIZE, ptr);
+        ptr = e::packvarint64(i, ptr);
+        ptr = e::packvarint64(block_size, ptr);
+
+        if (series_loggers_by_handle[i]->encoding)
+        {
+            ptr = e::packvarint64(CONFIG_ENCODING, ptr);
+            ptr = e::packvarint64(i, ptr);
+            ptr = e::packvarint64(series_loggers_by_handle[i]->encoding, ptr);
+        }
+
+        if (series[i]->indep_units == YGOR_UNIT_CYCLES ||
+            series[i]->dep_units == YGOR_UNIT_CYCLES)
+        {
+            ptr = e::packvarint64(CONFIG_CYCLES_PER_SECOND, ptr);
+            ptr = e::packvarint64(i, ptr);
+            ptr = e::packvarint64(cycles_per_second, ptr);
+        }
+
+        if (series_loggers_by_handle[i]->sampling_ratio() > 1)
+        {
+            ptr = e::packvarint64(CONFIG_SAMPLING_RATIO, ptr);
+            ptr = e::packvarint64(i, ptr);
+            ptr = e::packvarint64(series_loggers_by_handle[i]->sampling_ratio(), ptr);
+        }
+
+        if (series_loggers_by_handle[i]->hist)
+        {
+            ptr = e::packvarint64(CONFIG_HISTOGRAM_INTERVAL, ptr);
+            ptr = e::packvarint64(i, ptr);
+            ptr = e::packvarint64(series_loggers_by_handle[i]->hist_interval, ptr);
+            ptr = e::packvarint64(CONFIG_HISTOGRAM_PRECISION, ptr);
+            ptr = e::packvarint64(i, ptr);
+            ptr = e::packvarint64(series_loggers_by_handle[i]->hist->precision(), ptr);
+        }
+    }
+
+    size_t buf_sz = ptr - &buf[0];
+    e::pack64be(buf_sz - sizeof(uint64_t), &buf[0]);
+    return append(&buf[0], buf_sz);
+}
+
+// Write one block and enter it in the index.  Through stdio, the block is
+// written holding output_mtx.  Direct output holds it only to reserve the
+// block's place in the file, so that blocks of different series are written
+// concurrently.
+int
+ygor_data_logger :: write_block(const unsigned char* buf, size_t buf_sz,
+                                const ygor_series_logger* ysl,
+                                uint64_t count, uint64_t min, uint64_t max,
+                                const block_summary& summary)
+{
+    direct_output* d = NULL;
+    uint64_t offset = 0;
+    int ret = 0;
+
+    {
+        po6::threads::mutex::hold hold(&output_mtx);
+
+        if (!output && !direct)
+        {
+            return -1;
+        }
+
+        offset = output_offset;
+        index.push_back(index_entry(ysl->sindex, offset, count, min, max, summary));
+        output_offset += buf_sz;
+
+        if (direct)
+        {
+            d = direct;
+            d->reserve(output_offset, preallocate);
+            ++d->pending;
+        }
+        else if (fwrite(buf, 1, buf_sz, output) != buf_sz)
+        {
+            return -1;
+        }
+
+        if (index.size() >= INDEX_CHUNK_ENTRIES && write_index_chunk() < 0)
+        {
+            ret = -1;
+        }
+
+        if (segmented &&
+            ((segment_bytes > 0 && output_offset >= segment_bytes) ||
+             (segment_interval > 0 && po6::monotonic_time() - segment_start >= segment_interval)) &&
+            roll_segment() < 0)
+        {
+            ret = -1;
+        }
+    }
+
+    if (d && uring && uring->submit(d, buf, buf_sz, offset))
+    {
+        return ret;
+    }
+
+    if (d)
+    {
+        if (d->write_at(buf, buf_sz, offset) < 0)
+        {
+            ret = -1;
+        }
+
+        po6::threads::mutex::hold hold(&output_mtx);
+
+        if (release_direct(d) < 0)
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int
+ygor_data_logger :: write_index_chunk()
+{
+    if (index.empty())
+    {
+        return 0;
+    }
+
+    std::vector<unsigned char> buf(sizeof(uint64_t) + 3 * VARINT_64_MAX_SIZE +
+                                   index.size() * INDEX_ENTRY_SIZE);
+    unsigned char* ptr = &buf[0] + sizeof(uint64_t);
+    ptr = e::packvarint64(INDEX_BLOCK, ptr);
+    ptr = e::packvarint64(index_prev_chunk, ptr);
+    ptr = e::packvarint64(index.size(), ptr);
+
+    for (size_t i = 0; i < index.size(); ++i)
+    {
+        ptr = e::packvarint64(index[i].series, ptr);
+        ptr = e::packvarint64(index[i].offset, ptr);
+        ptr = e::packvarint64(index[i].count, ptr);
+        ptr = e::pack64be(index[i].min, ptr);
+        ptr = e::pack64be(index[i].max, ptr);
+        const block_summary& bs(index[i].summary);
+        ptr = e::packvarint64(bs.count, ptr);
+        ptr = e::packdoublebe(bs.indep_sum, ptr);
+        ptr = e::packdoublebe(bs.indep_sumsq, ptr);
+        ptr = e::packdoublebe(bs.dep_min, ptr);
+        ptr = e::packdoublebe(bs.dep_max, ptr);
+        ptr = e::packdoublebe(bs.dep_sum, ptr);
+        ptr = e::packdoublebe(bs.dep_sumsq, ptr);
+    }
+
+    size_t buf_sz = ptr - &buf[0];
+    e::pack64be(buf_sz - sizeof(uint64_t), &buf[0]);
+    index_prev_chunk = output_offset + 1;
+    index.clear();
+    return append(&buf[0], buf_sz) ? 0 : -1;
+}
+
+int
+ygor_data_logger :: write_trailer()
+{
+    if (write_index_chunk() < 0)
+    {
+        return -1;
+    }
+
+    if (index_prev_chunk == 0)
+    {
+        return 0;
+    }
+
+    unsigned char buf[TRAILER_SIZE];
+    unsigned char* ptr = buf + sizeof(uint64_t);
+    ptr = e::packvarint64(TRAILER_BLOCK, ptr);
+    ptr = e::pack64be(index_prev_chunk - 1, ptr);
+    memmove(ptr, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    ptr += sizeof(INDEX_MAGIC);
+    assert(ptr == buf + TRAILER_SIZE);
+    e::pack64be(TRAILER_SIZE - sizeof(uint64_t), buf);
+    return append(buf, TRAILER_SIZE) ? 0 : -1;
+}
+
+size_t
+ygor_data_logger :: series_index(const ygor_series* s)
+{
+    for (size_t i = 0; i < series_sz; ++i)
+    {
+        if (series[i] == s)
+        {
+            return i;
+        }
+    }
+
+    return series_sz;
+}
+
+ygor_series_logger*
+ygor_data_logger :: get_series_logger(const ygor_series* s)
+{
+    ygor_series_logger* ysl = NULL;
+    return series_loggers.get(s, &ysl) ? ysl : NULL;
+}
+
+ygor_series_logger*
+ygor_data_logger :: get_series_logger(ygor_series_handle h)
+{
+    return h < series_sz ? series_loggers_by_handle[h] : NULL;
+}
+
+thread_buffers*
+ygor_data_logger :: get_thread_buffers()
+{
+    void* ptr = pthread_getspecific(thread_buffers_key);
+
+    if (ptr)
+    {
+        return static_cast<thread_buffers*>(ptr);
+    }
+
+    thread_buffers* tb = new thread_buffers(this);
+
+    if (pthread_setspecific(thread_buffers_key, tb) != 0)
+    {
+        delete tb;
+        return NULL;
+    }
+
+    po6::threads::mutex::hold hold(&thread_buffers_mtx);
+    thread_buffers_list.push_back(tb);
+    return tb;
+}
+
+void
+ygor_data_logger :: release_thread_buffers(thread_buffers* tb)
+{
+    // called as the owning thread exits
+    int ret = tb->flush();
+    po6::threads::mutex::hold hold(&thread_buffers_mtx);
+    thread_buffers_list.remove(tb);
+    thread_buffers_failed = thread_buffers_failed || ret < 0;
+    delete tb;
+}
+
+ygor_data_point*
+ygor_data_logger :: allocate_block()
+{
+    po6::threads::mutex::hold hold(&pool_mtx);
+
+    if (free_blocks.empty())
+    {
+        ygor_data_point* slab = new ygor_data_point[block_size * BLOCKS_PER_SLAB];
+        slabs.push_back(slab);
+
+        for (size_t i = BLOCKS_PER_SLAB; i > 0; --i)
+        {
+            free_blocks.push_back(slab + (i - 1) * block_size);
+        }
+    }
+
+    ygor_data_point* points = free_blocks.back();
+    free_blocks.pop_back();
+    return points;
+}
+
+void
+ygor_data_logger :: release_block(ygor_data_point* points)
+{
+    po6::threads::mutex::hold hold(&pool_mtx);
+    free_blocks.push_back(points);
+}
+
+// Write the points, or queue them for the writer and replace them with an
+// empty block.  When the overload policy drops them instead, the caller keeps
+// its block to fill anew.
+int
+ygor_data_logger :: hand_off(ygor_series_logger* ysl, ygor_data_point** points, size_t points_sz, bool may_drop)
+{
+    may_drop = may_drop && drop_on_overload;
+
+    if (!writer_thread)
+    {
+        if (may_drop && !ysl->claim_write())
+        {
+            count_dropped(points_sz);
+            return 0;
+        }
+
+        int ret = 0;
+
+        {
+            po6::threads::mutex::hold hold(&ysl->io_mtx);
+            ret = ysl->write(*points, points_sz);
+        }
+
+        if (may_drop)
+        {
+            ysl->release_write();
+        }
+
+        return ret;
+    }
+
+    po6::threads::mutex::hold hold(&writer_mtx);
+
+    // over budget, wait for the writer to catch up or drop these points
+    while (writer_queue.size() + (writer_busy ? 1 : 0) >= queue_limit)
+    {
+        if (may_drop)
+        {
+            count_dropped(points_sz);
+            return writer_failed ? -1 : 0;
+        }
+
+        block_freed.wait();
+    }
+
+    writer_queue.push_back(pending_block(ysl, *points, points_sz));
+    writer_cond.signal();
+    *points = allocate_block();
+    return writer_failed ? -1 : 0;
+}
+
+void
+ygor_data_logger :: count_dropped(uint64_t points)
+{
+    po6::threads::mutex::hold hold(&dropped_mtx);
+    dropped += points;
+}
+
+// Record the points dropped since the last call as one point of the dropped
+// series, timestamped with the wallclock time in milliseconds
+int
+ygor_data_logger :: record_dropped()
+{
+    uint64_t points = 0;
+
+    {
+        po6::threads::mutex::hold hold(&dropped_mtx);
+        points = dropped;
+        dropped = 0;
+    }
+
+    if (points == 0)
+    {
+        return 0;
+    }
+
+    ygor_data_point ydp;
+    ydp.series = &dropped_series;
+    ydp.indep.precise = po6::wallclock_time() / PO6_MILLIS;
+    ydp.dep.precise = points;
+    return series_loggers_by_handle[series_sz - 1]->record(&ydp);
+}
+
+void
+ygor_data_logger :: writer()
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    if (writer_cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(writer_cpu, &cpus);
+        // failure to pin is not fatal; the writer just runs unpinned
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif
+
+    po6::threads::mutex::hold hold(&writer_mtx);
+
+    while (true)
+    {
+        while (writer_queue.empty() && !writer_shutdown)
+        {
+            writer_cond.wait();
+        }
+
+        if (writer_queue.empty())
+        {
+            break;
+        }
+
+        pending_block pb = writer_queue.front();
+        writer_queue.pop_front();
+        writer_busy = true;
+        writer_mtx.unlock();
+        int ret = 0;
+
+        {
+            po6::threads::mutex::hold hold_io(&pb.ysl->io_mtx);
+            ret = pb.ysl->write(pb.points, pb.points_sz);
+        }
+
+        writer_mtx.lock();
+        writer_busy = false;
+        writer_failed = writer_failed || ret < 0;
+        release_block(pb.points);
+        block_freed.signal();
+
+        if (writer_queue.empty())
+        {
+            writer_drained.broadcast();
+        }
+    }
+}
+
+// Wait for the writer to write every block queued so far
+int
+ygor_data_logger :: drain_writer()
+{
+    if (!writer_thread)
+    {
+        return 0;
+    }
+
+    po6::threads::mutex::hold hold(&writer_mtx);
+
+    while (!writer_queue.empty() || writer_busy)
+    {
+        writer_drained.wait();
+    }
+
+    return writer_failed ? -1 : 0;
+}
+
+int
+ygor_data_logger :: stop_writer()
+{
+    if (!writer_thread)
+    {
+        return 0;
+    }
+
+    writer_mtx.lock();
+    writer_shutdown = true;
+    writer_cond.broadcast();
+    writer_mtx.unlock();
+    writer_thread->join();
+    delete writer_thread;
+    writer_thread = NULL;
+    return writer_failed ? -1 : 0;
+}
+
+// Push every partially filled block (and histogram) to the file.  Recording
+// may continue concurrently; points recorded during the flush may or may not
+// be included.
+int
+ygor_data_logger :: flush()
+{
+    int ret = flush_thread_buffers();
+
+    if (drop_on_overload && record_dropped() < 0)
+    {
+        ret = -1;
+    }
+
+    for (size_t i = 0; i < series_sz; ++i)
+    {
+        ygor_series_logger* ysl = series_loggers_by_handle[i];
+
+        if (!ysl || ysl->flush() < 0)
+        {
+            ret = -1;
+        }
+    }
+
+    if (drain_writer() < 0)
+    {
+        ret = -1;
+    }
+
+    for (size_t i = 0; i < series_sz; ++i)
+    {
+        ygor_series_logger* ysl = series_loggers_by_handle[i];
+
+        if (!ysl)
+        {
+            continue;
+        }
+
+        po6::threads::mutex::hold hold(&ysl->io_mtx);
+
+        if (ysl->finish() < 0)
+        {
+            ret = -1;
+        }
+    }
+
+    if (uring && uring->drain() < 0)
+    {
+        ret = -1;
+    }
+
+    po6::threads::mutex::hold hold(&output_mtx);
+
+    // direct output is written with pwrite and has nothing buffered
+    if (direct)
+    {
+        return ret;
+    }
+
+    return output && fflush(output) == 0 ? ret : -1;
+}
+
+void
+ygor_data_logger :: flusher()
+{
+    po6::threads::mutex::hold hold(&flusher_mtx);
+
+    while (!flusher_shutdown)
+    {
+        flusher_cond.wait(flush_interval);
+
+        if (flusher_shutdown)
+        {
+            break;
+        }
+
+        flusher_mtx.unlock();
+        int ret = flush();
+        flusher_mtx.lock();
+        flusher_failed = flusher_failed || ret < 0;
+    }
+}
+
+int
+ygor_data_logger :: stop_flusher()
+{
+    if (!flusher_thread)
+    {
+        return 0;
+    }
+
+    flusher_mtx.lock();
+    flusher_shutdown = true;
+    flusher_cond.broadcast();
+    flusher_mtx.unlock();
+    flusher_thread->join();
+    delete flusher_thread;
+    flusher_thread = NULL;
+    return flusher_failed ? -1 : 0;
+}
+
+int
+ygor_data_logger :: flush_thread_buffers()
+{
+    po6::threads::mutex::hold hold(&thread_buffers_mtx);
+    int ret = thread_buffers_failed ? -1 : 0;
+
+    for (std::list<thread_buffers*>::iterator it = thread_buffers_list.begin();
+            it != thread_buffers_list.end(); ++it)
+    {
+        if ((*it)->flush() < 0)
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+// Blocks are sorted on an unsigned 64-bit key derived from the independent
+// value.  Doubles are mapped to a key with the same order by flipping the sign
+// bit of non-negative values and every bit of negative values.
+typedef uint64_t (*sort_key_func_t)(const ygor_data_point& p);
+
+// a block with at most this many out-of-order neighbors is sorted by merging
+// its ascending runs
+#define NEARLY_SORTED_DESCENTS 8
+
+static inline uint64_t
+sort_key_precise(const ygor_data_point& p)
+{
+    return p.indep.precise;
+}
+
+static inline uint64_t
+sort_key_approximate(const ygor_data_point& p)
+{
+    uint64_t x;
+    memcpy(&x, &p.indep.approximate, sizeof(x));
+    return (x & 0x8000000000000000ULL) ? ~x : (x | 0x8000000000000000ULL);
+}
+
+// Merge each ascending run of a block into the sorted run before it, in
+// scratch.  Only the part of the sorted prefix that overlaps the next run is
+// moved, so a batch appended slightly out of order costs little more than
+// copying it.
+template <sort_key_func_t K>
+void
+merge_runs(ygor_data_point* points, size_t points_sz, std::vector<ygor_data_point>* scratch)
+{
+    if (scratch->size() < points_sz)
+    {
+        scratch->resize(points_sz);
+    }
+
+    ygor_data_point* tmp = &(*scratch)[0];
+
+    for (size_t b = 1; b < points_sz; ++b)
+    {
+        if (K(points[b]) >= K(points[b - 1]))
+        {
+            continue;
+        }
+
+        size_t e = b + 1;
+
+        while (e < points_sz && K(points[e]) >= K(points[e - 1]))
+        {
+            ++e;
+        }
+
+        // points[0, b) is sorted; find where the run [b, e) starts to overlap
+        const uint64_t first = K(points[b]);
+        size_t lo = 0;
+        size_t hi = b;
+
+        while (lo < hi)
+        {
+            const size_t mid = lo + (hi - lo) / 2;
+
+            if (K(points[mid]) <= first)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        size_t i = lo;
+        size_t j = b;
+        size_t o = 0;
+
+        while (i < b && j < e)
+        {
+            tmp[o++] = K(points[j]) < K(points[i]) ? points[j++] : points[i++];
+        }
+
+        while (i < b)
+        {
+            tmp[o++] = points[i++];
+        }
+
+        while (j < e)
+        {
+            tmp[o++] = points[j++];
+        }
+
+        memcpy(points + lo, tmp, o * sizeof(ygor_data_point));
+        b = e - 1;
+    }
+}
+
+// LSD radix sort, one byte of the key per pass.  Bytes that are the same for
+// every point in the block (the high bytes of nearby timestamps) are skipped.
+template <sort_key_func_t K>
+void
+radix_sort(ygor_data_point* points, size_t points_sz, std::vector<ygor_data_point>* scratch)
+{
+    uint32_t counts[sizeof(uint64_t)][256];
+    memset(counts, 0, sizeof(counts));
+
+    for (size_t i = 0; i < points_sz; ++i)
+    {
+        const uint64_t k = K(points[i]);
+
+        for (size_t d = 0; d < sizeof(uint64_t); ++d)
+        {
+            ++counts[d][(k >> (8 * d)) & 0xff];
+        }
+    }
+
+    if (scratch->size() < points_sz)
+    {
+        scratch->resize(points_sz);
+    }
+
+    ygor_data_point* src = points;
+    ygor_data_point* dst = &(*scratch)[0];
+
+    for (size_t d = 0; d < sizeof(uint64_t); ++d)
+    {
+        const uint64_t first = (K(src[0]) >> (8 * d)) & 0xff;
+
+        if (counts[d][first] == points_sz)
+        {
+            continue;
+        }
+
+        uint32_t offset = 0;
+
+        for (size_t b = 0; b < 256; ++b)
+        {
+            const uint32_t c = counts[d][b];
+            counts[d][b] = offset;
+            offset += c;
+        }
+
+        for (size_t i = 0; i < points_sz; ++i)
+        {
+            dst[counts[d][(K(src[i]) >> (8 * d)) & 0xff]++] = src[i];
+        }
+
+        std::swap(src, dst);
+    }
+
+    if (src != points)
+    {
+        memcpy(points, src, points_sz * sizeof(ygor_data_point));
+    }
+}
+
+template <sort_key_func_t K>
+void
+sort_func_templ(ygor_data_point* points, size_t points_sz, std::vector<ygor_data_point>* scratch)
+{
+    // a single producer recording in time order fills blocks that are already
+    // sorted, so check for that in one pass before doing any sorting
+    size_t descents = 0;
+
+    for (size_t i = 1; i < points_sz; ++i)
+    {
+        if (K(points[i]) < K(points[i - 1]))
+        {
+            ++descents;
+        }
+    }
+
+    if (descents == 0)
+    {
+        return;
+    }
+    else if (descents <= NEARLY_SORTED_DESCENTS)
+    {
+        merge_runs<K>(points, points_sz, scratch);
+    }
+    else
+    {
+        radix_sort<K>(points, points_sz, scratch);
+    }
+}
+
+sort_func_t
+ygor_series_logger :: sort_func(const ygor_series* s)
+{
+    switch (s->indep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return sort_func_templ<sort_key_precise>;
+        case YGOR_HALF_PRECISION: return sort_func_templ<sort_key_approximate>;
+        case YGOR_SINGLE_PRECISION: return sort_func_templ<sort_key_approximate>;
+        case YGOR_DOUBLE_PRECISION: return sort_func_templ<sort_key_approximate>;
+        default: return NULL;
+    }
+}
+
+template <ygor_precision P>
+unsigned char* pack_value_templ(const ygor_data_value& v, unsigned char* out);
+
+template <>
+unsigned char*
+pack_value_templ<YGOR_PRECISE_INTEGER>(const ygor_data_value& v, unsigned char* out)
+{
+    return e::packvarint64(v.precise, out);
+}
+
+template <>
+unsigned char*
+pack_value_templ<YGOR_HALF_PRECISION>(const ygor_data_value& v, unsigned char* out)
+{
+    uint16_t h = halffloat_compress(v.approximate);
+    return e::pack16be(h, out);
+}
+
+template <>
+unsigned char*
+pack_value_templ<YGOR_SINGLE_PRECISION>(const ygor_data_value& v, unsigned char* out)
+{
+    return e::packfloatbe(v.approximate, out);
+}
+
+template <>
+unsigned char*
+pack_value_templ<YGOR_DOUBLE_PRECISION>(const ygor_data_value& v, unsigned char* out)
+{
+    return e::packdoublebe(v.approximate, out);
+}
+
+template <ygor_precision P>
+const unsigned char* unpack_value_templ(const unsigned char* in, const unsigned char* end, ygor_data_value* v);
+
+template <>
+const unsigned char*
+unpack_value_templ<YGOR_PRECISE_INTEGER>(const unsigned char* in, const unsigned char* end, ygor_data_value* v)
+{
+    if (!in) return NULL;
+    return e::varint64_decode(in, end, &v->precise);
+}
+
+template <>
+const unsigned char*
+unpack_value_templ<YGOR_HALF_PRECISION>(const unsigned char* in, const unsigned char* end, ygor_data_value* v)
+{
+    if (!in) return NULL;
+    if (end - in < 2) return NULL;
+    uint16_t h;
+    in = e::unpack16be(in, &h);
+    v->approximate = halffloat_decompress(h);
+    return in;
+}
+
+template <>
+const unsigned char*
+unpack_value_templ<YGOR_SINGLE_PRECISION>(const unsigned char* in, const unsigned char* end, ygor_data_value* v)
+{
+    if (!in) return NULL;
+    if (end - in < 4) return NULL;
+    float x;
+    in = e::unpackfloatbe(in, &x);
+    v->approximate = x;
+    return in;
+}
+
+template <>
+const unsigned char*
+unpack_value_templ<YGOR_DOUBLE_PRECISION>(const unsigned char* in, const unsigned char* end, ygor_data_value* v)
+{
+    if (!in) return NULL;
+    if (end - in < 8) return NULL;
+    return e::unpackdoublebe(in, &v->approximate);
+}
+
+template <ygor_precision I, ygor_precision D>
+unsigned char*
+pack_func_templ(const ygor_data_point*, ygor_data_point* point, unsigned char* out)
+{
+    out = pack_value_templ<I>(point->indep, out);
+    return pack_value_templ<D>(point->dep, out);
+}
+
+unsigned char*
+pack_func_ipi(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
+{
+    if (prev)
+    {
+        assert(prev->indep.precise <= point->indep.precise);
+        return e::packvarint64(point->indep.precise - prev->indep.precise, out);
+    }
+    else
+    {
+        return e::packvarint64(point->indep.precise, out);
+    }
+}
+
+unsigned char*
+pack_func_pi_pi(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
+{
+    out = pack_func_ipi(prev, point, out);
+    return pack_value_templ<YGOR_PRECISE_INTEGER>(point->dep, out);
+}
+
+unsigned char*
+pack_func_pi_hp(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
+{
+    out = pack_func_ipi(prev, point, out);
+    return pack_value_templ<YGOR_HALF_PRECISION>(point->dep, out);
+}
+
+unsigned char*
+pack_func_pi_sp(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
+{
+    out = pack_func_ipi(prev, point, out);
+    return pack_value_templ<YGOR_SINGLE_PRECISION>(point->dep, out);
+}
+
+unsigned char*
+pack_func_pi_dp(const ygor_data_point* prev, ygor_data_point* point, unsigned char* out)
+{
+    out = pack_func_ipi(prev, point, out);
+    return pack_value_templ<YGOR_DOUBLE_PRECISION>(point->dep, out);
+}
+
+pack_func_t
+pack_func_precise_integer(const ygor_series* s)
+{
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return pack_func_pi_pi;
+        case YGOR_HALF_PRECISION: return pack_func_pi_hp;
+        case YGOR_SINGLE_PRECISION: return pack_func_pi_sp;
+        case YGOR_DOUBLE_PRECISION: return pack_func_pi_dp;
+        default: return NULL;
+    }
+}
+
+pack_func_t
+pack_func_half_precision(const ygor_series* s)
+{
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return pack_func_templ<YGOR_HALF_PRECISION, YGOR_PRECISE_INTEGER>;
+        case YGOR_HALF_PRECISION: return pack_func_templ<YGOR_HALF_PRECISION, YGOR_HALF_PRECISION>;
+        case YGOR_SINGLE_PRECISION: return pack_func_templ<YGOR_HALF_PRECISION, YGOR_SINGLE_PRECISION>;
+        case YGOR_DOUBLE_PRECISION: return pack_func_templ<YGOR_HALF_PRECISION, YGOR_DOUBLE_PRECISION>;
+        default: return NULL;
+    }
+}
+
+pack_func_t
+pack_func_single_precision(const ygor_series* s)
+{
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return pack_func_templ<YGOR_SINGLE_PRECISION, YGOR_PRECISE_INTEGER>;
+        case YGOR_HALF_PRECISION: return pack_func_templ<YGOR_SINGLE_PRECISION, YGOR_HALF_PRECISION>;
+        case YGOR_SINGLE_PRECISION: return pack_func_templ<YGOR_SINGLE_PRECISION, YGOR_SINGLE_PRECISION>;
+        case YGOR_DOUBLE_PRECISION: return pack_func_templ<YGOR_SINGLE_PRECISION, YGOR_DOUBLE_PRECISION>;
+        default: return NULL;
+    }
+}
+
+pack_func_t
+pack_func_double_precision(const ygor_series* s)
+{
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return pack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_PRECISE_INTEGER>;
+        case YGOR_HALF_PRECISION: return pack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_HALF_PRECISION>;
+        case YGOR_SINGLE_PRECISION: return pack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_SINGLE_PRECISION>;
+        case YGOR_DOUBLE_PRECISION: return pack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_DOUBLE_PRECISION>;
+        default: return NULL;
+    }
+}
+
+pack_func_t
+ygor_series_logger :: pack_func(const ygor_series* s)
+{
+    switch (s->indep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return pack_func_precise_integer(s);
+        case YGOR_HALF_PRECISION: return pack_func_half_precision(s);
+        case YGOR_SINGLE_PRECISION: return pack_func_single_precision(s);
+        case YGOR_DOUBLE_PRECISION: return pack_func_double_precision(s);
+        default: return NULL;
+    }
+}
+
+// Block encodings
+//
+// An encoded block is a varint count of points followed by a bit stream that
+// holds each point's independent value and then its dependent value, most
+// significant bit first.  The stream is zero-padded to a whole byte.  Each
+// value is written by a codec that may remember earlier values in the block.
+//
+// With the columnar layout, the count is instead followed by the 32-bit
+// big-endian length of the independent column, the independent values of
+// every point, and then the dependent values of every point.  Each column is
+// padded to a whole byte, so a reader may decode either column alone.
+
+struct bit_packer
+{
+    bit_packer(unsigned char* out);
+    // write the low n bits of v
+    void put(uint64_t v, unsigned n);
+    unsigned char* finish();
+
+    unsigned char* m_out;
+    unsigned m_byte;
+    unsigned m_bits;
+};
+
+struct bit_unpacker
+{
+    bit_unpacker(const unsigned char* in, const unsigned char* end);
+    bool get(unsigned n, uint64_t* v);
+    // true if every byte of input was consumed
+    bool done() const;
+
+    const unsigned char* m_in;
+    const unsigned char* m_end;
+    unsigned m_byte;
+    unsigned m_bits;
+};
+
+bit_packer :: bit_packer(unsigned char* out)
+    : m_out(out)
+    , m_byte(0)
+    , m_bits(0)
+{
+}
+
+void
+bit_packer :: put(uint64_t v, unsigned n)
+{
+    while (n > 0)
+    {
+        const unsigned take = std::min(n, 8 - m_bits);
+        m_byte = (m_byte << take) | ((v >> (n - take)) & ((1U << take) - 1));
+        m_bits += take;
+        n -= take;
+
+        if (m_bits == 8)
+        {
+            *m_out = m_byte;
+            ++m_out;
+            m_byte = 0;
+            m_bits = 0;
+        }
+    }
+}
+
+unsigned char*
+bit_packer :: finish()
+{
+    if (m_bits > 0)
+    {
+        put(0, 8 - m_bits);
+    }
+
+    return m_out;
+}
+
+bit_unpacker :: bit_unpacker(const unsigned char* in, const unsigned char* end)
+    : m_in(in)
+    , m_end(end)
+    , m_byte(0)
+    , m_bits(0)
+{
+}
+
+bool
+bit_unpacker :: get(unsigned n, uint64_t* v)
+{
+    uint64_t x = 0;
+
+    while (n > 0)
+    {
+        if (m_bits == 0)
+        {
+            if (m_in >= m_end)
+            {
+                return false;
+            }
+
+            m_byte = *m_in;
+            ++m_in;
+            m_bits = 8;
+        }
+
+        const unsigned take = std::min(n, m_bits);
+        x = (x << take) | ((m_byte >> (m_bits - take)) & ((1U << take) - 1));
+        m_bits -= take;
+        n -= take;
+    }
+
+    *v = x;
+    return true;
+}
+
+bool
+bit_unpacker :: done() const
+{
+    return m_in == m_end;
+}
+
+static inline uint64_t
+zigzag(int64_t x)
+{
+    return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63);
+}
+
+static inline int64_t
+unzigzag(uint64_t x)
+{
+    return static_cast<int64_t>(x >> 1) ^ -static_cast<int64_t>(x & 1);
+}
+
+// The value as it would be written by the original encoding, byte by byte.
+template <ygor_precision P>
+struct plain_codec
+{
+    plain_codec() {}
+    void pack(const ygor_data_value& v, bit_packer* bp);
+    bool unpack(bit_unpacker* bu, ygor_data_value* v);
+};
+
+template <>
+void
+plain_codec<YGOR_PRECISE_INTEGER> :: pack(const ygor_data_value& v, bit_packer* bp)
+{
+    unsigned char buf[VARINT_64_MAX_SIZE];
+    unsigned char* end = e::packvarint64(v.precise, buf);
+
+    for (unsigned char* ptr = buf; ptr < end; ++ptr)
+    {
+        bp->put(*ptr, 8);
+    }
+}
+
+template <>
+bool
+plain_codec<YGOR_PRECISE_INTEGER> :: unpack(bit_unpacker* bu, ygor_data_value* v)
+{
+    unsigned char buf[VARINT_64_MAX_SIZE];
+    size_t buf_sz = 0;
+    uint64_t byte = 0x80;
+
+    while ((byte & 0x80) && buf_sz < VARINT_64_MAX_SIZE)
+    {
+        if (!bu->get(8, &byte))
+        {
+            return false;
+        }
+
+        buf[buf_sz] = byte;
+        ++buf_sz;
+    }
+
+    return e::varint64_decode(buf, buf + buf_sz, &v->precise) != NULL;
+}
+
+template <>
+void
+plain_codec<YGOR_HALF_PRECISION> :: pack(const ygor_data_value& v, bit_packer* bp)
+{
+    bp->put(halffloat_compress(v.approximate), 16);
+}
+
+template <>
+bool
+plain_codec<YGOR_HALF_PRECISION> :: unpack(bit_unpacker* bu, ygor_data_value* v)
+{
+    uint64_t h;
+
+    if (!bu->get(16, &h))
+    {
+        return false;
+    }
+
+    v->approximate = halffloat_decompress(h);
+    return true;
+}
+
+template <>
+void
+plain_codec<YGOR_SINGLE_PRECISION> :: pack(const ygor_data_value& v, bit_packer* bp)
+{
+    float f = v.approximate;
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    bp->put(x, 32);
+}
+
+template <>
+bool
+plain_codec<YGOR_SINGLE_PRECISION> :: unpack(bit_unpacker* bu, ygor_data_value* v)
+{
+    uint64_t x;
+
+    if (!bu->get(32, &x))
+    {
+        return false;
+    }
+
+    uint32_t y = x;
+    float f;
+    memcpy(&f, &y, sizeof(f));
+    v->approximate = f;
+    return true;
+}
+
+template <>
+void
+plain_codec<YGOR_DOUBLE_PRECISION> :: pack(const ygor_data_value& v, bit_packer* bp)
+{
+    uint64_t x;
+    memcpy(&x, &v.approximate, sizeof(x));
+    bp->put(x, 64);
+}
+
+template <>
+bool
+plain_codec<YGOR_DOUBLE_PRECISION> :: unpack(bit_unpacker* bu, ygor_data_value* v)
+{
+    uint64_t x;
+
+    if (!bu->get(64, &x))
+    {
+        return false;
+    }
+
+    memcpy(&v->approximate, &x, sizeof(x));
+    return true;
+}
+
+// Gorilla-style delta-of-delta for precise values.  The first value is
+// written in full; after that, the zigzagged difference between consecutive
+// deltas is written behind a prefix that selects its width:
+//     0                  difference is zero
+//     10   + 7 bits
+//     110  + 14 bits
+//     1110 + 28 bits
+//     1111 + 64 bits
+// Evenly spaced timestamps take one bit per point.
+struct dod_codec
+{
+    dod_codec();
+    void pack(const ygor_data_value& v, bit_packer* bp);
+    bool unpack(bit_unpacker* bu, ygor_data_value* v);
+
+    bool m_first;
+    uint64_t m_prev;
+    uint64_t m_delta;
+};
+
+dod_codec :: dod_codec()
+    : m_first(true)
+    , m_prev(0)
+    , m_delta(0)
+{
+}
+
+void
+dod_codec :: pack(const ygor_data_value& v, bit_packer* bp)
+{
+    if (m_first)
+    {
+        bp->put(v.precise, 64);
+        m_first = false;
+        m_prev = v.precise;
+        return;
+    }
+
+    const uint64_t delta = v.precise - m_prev;
+    const uint64_t z = zigzag(static_cast<int64_t>(delta - m_delta));
+    m_prev = v.precise;
+    m_delta = delta;
+
+    if (z == 0)
+    {
+        bp->put(0, 1);
+    }
+    else if (z < (1ULL << 7))
+    {
+        bp->put(0x2, 2);
+        bp->put(z, 7);
+    }
+    else if (z < (1ULL << 14))
+    {
+        bp->put(0x6, 3);
+        bp->put(z, 14);
+    }
+    else if (z < (1ULL << 28))
+    {
+        bp->put(0xe, 4);
+        bp->put(z, 28);
+    }
+    else
+    {
+        bp->put(0xf, 4);
+        bp->put(z, 64);
+    }
+}
+
+bool
+dod_codec :: unpack(bit_unpacker* bu, ygor_data_value* v)
+{
+    if (m_first)
+    {
+        m_first = false;
+
+        if (!bu->get(64, &m_prev))
+        {
+            return false;
+        }
+
+        v->precise = m_prev;
+        return true;
+    }
+
+    static const unsigned widths[] = {7, 14, 28, 64};
+    unsigned prefix = 0;
+
+    while (prefix < 4)
+    {
+        uint64_t bit;
+
+        if (!bu->get(1, &bit))
+        {
+            return false;
+        }
+
+        if (!bit)
+        {
+            break;
+        }
+
+        ++prefix;
+    }
+
+    uint64_t z = 0;
+
+    if (prefix > 0 && !bu->get(widths[prefix - 1], &z))
+    {
+        return false;
+    }
+
+    m_delta += static_cast<uint64_t>(unzigzag(z));
+    m_prev += m_delta;
+    v->precise = m_prev;
+    return true;
+}
+
+// The original encoding of precise independent values: a varint delta from
+// the previous point in the block.
+struct delta_codec
+{
+    delta_codec();
+    void pack(const ygor_data_value& v, bit_packer* bp);
+    bool unpack(bit_unpacker* bu, ygor_data_value* v);
+
+    uint64_t m_prev;
+};
+
+delta_codec :: delta_codec()
+    : m_prev(0)
+{
+}
+
+void
+delta_codec :: pack(const ygor_data_value& v, bit_packer* bp)
+{
+    ygor_data_value delta;
+    delta.precise = v.precise - m_prev;
+    m_prev = v.precise;
+    plain_codec<YGOR_PRECISE_INTEGER>().pack(delta, bp);
+}
+
+bool
+delta_codec :: unpack(bit_unpacker* bu, ygor_data_value* v)
+{
+    ygor_data_value delta;
+
+    if (!plain_codec<YGOR_PRECISE_INTEGER>().unpack(bu, &delta))
+    {
+        return false;
+    }
+
+    m_prev += delta.precise;
+    v->precise = m_prev;
+    return true;
+}
+
+// Gorilla-style XOR compression of single or double precision values.  The
+// first value is written in full; after that, each value is XORed with its
+// predecessor and written as:
+//     0                         same as the previous value
+//     10 + meaningful bits      nonzero bits fall within the previous window
+//     11 + 6 bits of leading zeros + 6 bits of (length - 1) + meaningful bits
+// Values that hover around one another share their sign, exponent, and high
+// mantissa bits, leaving a short window of differing bits.
+template <ygor_precision P>
+struct xor_codec
+{
+    static const unsigned WIDTH = P == YGOR_SINGLE_PRECISION ? 32 : 64;
+
+    xor_codec();
+    void pack(const ygor_data_value& v, bit_packer* bp);
+    bool unpack(bit_unpacker* bu, ygor_data_value* v);
+
+    static uint64_t to_bits(double d);
+    static double from_bits(uint64_t x);
+
+    bool m_first;
+    uint64_t m_prev;
+    unsigned m_lead;
+    unsigned m_trail;
+};
+
+template <>
+uint64_t
+xor_codec<YGOR_SINGLE_PRECISION> :: to_bits(double d)
+{
+    float f = d;
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    return x;
+}
+
+template <>
+double
+xor_codec<YGOR_SINGLE_PRECISION> :: from_bits(uint64_t x)
+{
+    uint32_t y = x;
+    float f;
+    memcpy(&f, &y, sizeof(f));
+    return f;
+}
+
+template <>
+uint64_t
+xor_codec<YGOR_DOUBLE_PRECISION> :: to_bits(double d)
+{
+    uint64_t x;
+    memcpy(&x, &d, sizeof(x));
+    return x;
+}
+
+template <>
+double
+xor_codec<YGOR_DOUBLE_PRECISION> :: from_bits(uint64_t x)
+{
+    double d;
+    memcpy(&d, &x, sizeof(d));
+    return d;
+}
+
+template <ygor_precision P>
+xor_codec<P> :: xor_codec()
+    : m_first(true)
+    , m_prev(0)
+    , m_lead(WIDTH)
+    , m_trail(0)
+{
+}
+
+template <ygor_precision P>
+void
+xor_codec<P> :: pack(const ygor_data_value& v, bit_packer* bp)
+{
+    const uint64_t bits = to_bits(v.approximate);
+
+    if (m_first)
+    {
+        bp->put(bits, WIDTH);
+        m_first = false;
+        m_prev = bits;
+        return;
+    }
+
+    const uint64_t x = bits ^ m_prev;
+    m_prev = bits;
+
+    if (x == 0)
+    {
+        bp->put(0, 1);
+        return;
+    }
+
+    const unsigned lead = __builtin_clzll(x) - (64 - WIDTH);
+    const unsigned trail = __builtin_ctzll(x);
+
+    if (m_lead + m_trail < WIDTH && lead >= m_lead && trail >= m_trail)
+    {
+        bp->put(0x2, 2);
+        bp->put(x >> m_trail, WIDTH - m_lead - m_trail);
+        return;
+    }
+
+    const unsigned len = WIDTH - lead - trail;
+    bp->put(0x3, 2);
+    bp->put(lead, 6);
+    bp->put(len - 1, 6);
+    bp->put(x >> trail, len);
+    m_lead = lead;
+    m_trail = trail;
+}
+
+template <ygor_precision P>
+bool
+xor_codec<P> :: unpack(bit_unpacker* bu, ygor_data_value* v)
+{
+    if (m_first)
+    {
+        m_first = false;
+
+        if (!bu->get(WIDTH, &m_prev))
+        {
+            return false;
+        }
+
+        v->approximate = from_bits(m_prev);
+        return true;
+    }
+
+    uint64_t bit;
+
+    if (!bu->get(1, &bit))
+    {
+        return false;
+    }
+
+    if (bit)
+    {
+        if (!bu->get(1, &bit))
+        {
+            return false;
+        }
+
+        if (bit)
+        {
+            uint64_t lead;
+            uint64_t len;
+
+            if (!bu->get(6, &lead) || !bu->get(6, &len) ||
+                lead + len + 1 > WIDTH)
+            {
+                return false;
+            }
+
+            m_lead = lead;
+            m_trail = WIDTH - lead - len - 1;
+        }
+        else if (m_lead + m_trail >= WIDTH)
+        {
+            return false;
+        }
+
+        uint64_t x;
+
+        if (!bu->get(WIDTH - m_lead - m_trail, &x))
+        {
+            return false;
+        }
+
+        m_prev ^= x << m_trail;
+    }
+
+    v->approximate = from_bits(m_prev);
+    return true;
+}
+
+// One column of a columnar block, one codec applied to every point in turn.
+// Codecs that need no bit stream get byte-aligned loops instead.
+template <typename C>
+struct column
+{
+    static unsigned char* pack(const ygor_data_point* points, size_t points_sz,
+                               ygor_data_value ygor_data_point::*v, unsigned char* out);
+    static bool unpack(const unsigned char* in, const unsigned char* end,
+                       ygor_data_point* points, size_t points_sz,
+                       ygor_data_value ygor_data_point::*v);
+};
+
+template <typename C>
+unsigned char*
+column<C> :: pack(const ygor_data_point* points, size_t points_sz,
+                  ygor_data_value ygor_data_point::*v, unsigned char* out)
+{
+    bit_packer bp(out);
+    C c;
+
+    for (size_t i = 0; i < points_sz; ++i)
+    {
+        c.pack(points[i].*v, &bp);
+    }
+
+    return bp.finish();
+}
+
+template <typename C>
+bool
+column<C> :: unpack(const unsigned char* in, const unsigned char* end,
+                    ygor_data_point* points, size_t points_sz,
+                    ygor_data_value ygor_data_point::*v)
+{
+    bit_unpacker bu(in, end);
+    C c;
+
+    for (size_t i = 0; i < points_sz; ++i)
+    {
+        if (!c.unpack(&bu, &(points[i].*v)))
+        {
+            return false;
+        }
+    }
+
+    return bu.done();
+}
+
+template <ygor_precision P>
+struct column<plain_codec<P> >
+{
+    static unsigned char* pack(const ygor_data_point* points, size_t points_sz,
+                               ygor_data_value ygor_data_point::*v, unsigned char* out)
+    {
+        for (size_t i = 0; i < points_sz; ++i)
+        {
+            out = pack_value_templ<P>(points[i].*v, out);
+        }
+
+        return out;
+    }
+
+    static bool unpack(const unsigned char* in, const unsigned char* end,
+                       ygor_data_point* points, size_t points_sz,
+                       ygor_data_value ygor_data_point::*v)
+    {
+        for (size_t i = 0; in && i < points_sz; ++i)
+        {
+            in = unpack_value_templ<P>(in, end, &(points[i].*v));
+        }
+
+        return in == end;
+    }
+};
+
+template <>
+struct column<delta_codec>
+{
+    static unsigned char* pack(const ygor_data_point* points, size_t points_sz,
+                               ygor_data_value ygor_data_point::*v, unsigned char* out)
+    {
+        uint64_t prev = 0;
+
+        for (size_t i = 0; i < points_sz; ++i)
+        {
+            out = e::packvarint64((points[i].*v).precise - prev, out);
+            prev = (points[i].*v).precise;
+        }
+
+        return out;
+    }
+
+    static bool unpack(const unsigned char* in, const unsigned char* end,
+                       ygor_data_point* points, size_t points_sz,
+                       ygor_data_value ygor_data_point::*v)
+    {
+        uint64_t prev = 0;
+
+        for (size_t i = 0; in && i < points_sz; ++i)
+        {
+            uint64_t delta = 0;
+            in = e::varint64_decode(in, end, &delta);
+            prev += delta;
+            (points[i].*v).precise = prev;
+        }
+
+        return in == end;
+    }
+};
+
+template <bool COLUMNAR, typename I, typename D>
+unsigned char*
+pack_block_templ(const ygor_data_point* points, size_t points_sz, unsigned char* out)
+{
+    out = e::packvarint64(points_sz, out);
+
+    if (COLUMNAR)
+    {
+        unsigned char* indep_start = out + sizeof(uint32_t);
+        out = column<I>::pack(points, points_sz, &ygor_data_point::indep, indep_start);
+        e::pack32be(out - indep_start, indep_start - sizeof(uint32_t));
+        return column<D>::pack(points, points_sz, &ygor_data_point::dep, out);
+    }
+
+    bit_packer bp(out);
+    I indep;
+    D dep;
+
+    for (size_t i = 0; i < points_sz; ++i)
+    {
+        indep.pack(points[i].indep, &bp);
+        dep.pack(points[i].dep, &bp);
+    }
+
+    return bp.finish();
+}
+
+template <bool COLUMNAR, typename I, typename D>
+bool
+unpack_block_templ(const unsigned char* in, const unsigned char* end,
+                   const ygor_series* s, bool skip_indep,
+                   std::vector<ygor_data_point>* points)
+{
+    uint64_t points_sz;
+    in = e::varint64_decode(in, end, &points_sz);
+
+    if (!in || points_sz > MAX_SERIES_BUFFER_SIZE)
+    {
+        return false;
+    }
+
+    if (COLUMNAR)
+    {
+        uint32_t indep_sz;
+
+        if (end - in < static_cast<ptrdiff_t>(sizeof(uint32_t)))
+        {
+            return false;
+        }
+
+        in = e::unpack32be(in, &indep_sz);
+
+        if (indep_sz > static_cast<size_t>(end - in))
+        {
+            return false;
+        }
+
+        const size_t base = points->size();
+        points->resize(base + points_sz);
+        ygor_data_point* out = &(*points)[0] + base;
+
+        for (size_t i = 0; i < points_sz; ++i)
+        {
+            out[i].series = s;
+            out[i].indep.precise = 0;
+        }
+
+        if (!skip_indep &&
+            !column<I>::unpack(in, in + indep_sz, out, points_sz, &ygor_data_point::indep))
+        {
+            return false;
+        }
+
+        return column<D>::unpack(in + indep_sz, end, out, points_sz, &ygor_data_point::dep);
+    }
+
+    bit_unpacker bu(in, end);
+    I indep;
+    D dep;
+
+    for (uint64_t i = 0; i < points_sz; ++i)
+    {
+        ygor_data_point p;
+        p.series = s;
+
+        if (!indep.unpack(&bu, &p.indep) || !dep.unpack(&bu, &p.dep))
+        {
+            return false;
+        }
+
+        points->push_back(p);
+    }
+
+    return bu.done();
+}
+
+template <bool C, typename I>
+pack_block_func_t
+pack_block_func_layout(const ygor_series* s, unsigned encoding)
+{
+    if (encoding & YGOR_ENCODING_XOR)
+    {
+        switch (s->dep_precision)
+        {
+            case YGOR_SINGLE_PRECISION: return pack_block_templ<C, I, xor_codec<YGOR_SINGLE_PRECISION> >;
+            case YGOR_DOUBLE_PRECISION: return pack_block_templ<C, I, xor_codec<YGOR_DOUBLE_PRECISION> >;
+            default: return NULL;
+        }
+    }
+
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return pack_block_templ<C, I, plain_codec<YGOR_PRECISE_INTEGER> >;
+        case YGOR_HALF_PRECISION: return pack_block_templ<C, I, plain_codec<YGOR_HALF_PRECISION> >;
+        case YGOR_SINGLE_PRECISION: return pack_block_templ<C, I, plain_codec<YGOR_SINGLE_PRECISION> >;
+        case YGOR_DOUBLE_PRECISION: return pack_block_templ<C, I, plain_codec<YGOR_DOUBLE_PRECISION> >;
+        default: return NULL;
+    }
+}
+
+template <typename I>
+pack_block_func_t
+pack_block_func_indep(const ygor_series* s, unsigned encoding)
+{
+    return (encoding & YGOR_ENCODING_COLUMNAR)
+         ? pack_block_func_layout<true, I>(s, encoding)
+         : pack_block_func_layout<false, I>(s, encoding);
+}
+
+template <bool C, typename I>
+unpack_block_func_t
+unpack_block_func_layout(const ygor_series* s, uint64_t encoding)
+{
+    if (encoding & YGOR_ENCODING_XOR)
+    {
+        switch (s->dep_precision)
+        {
+            case YGOR_SINGLE_PRECISION: return unpack_block_templ<C, I, xor_codec<YGOR_SINGLE_PRECISION> >;
+            case YGOR_DOUBLE_PRECISION: return unpack_block_templ<C, I, xor_codec<YGOR_DOUBLE_PRECISION> >;
+            default: return NULL;
+        }
+    }
+
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return unpack_block_templ<C, I, plain_codec<YGOR_PRECISE_INTEGER> >;
+        case YGOR_HALF_PRECISION: return unpack_block_templ<C, I, plain_codec<YGOR_HALF_PRECISION> >;
+        case YGOR_SINGLE_PRECISION: return unpack_block_templ<C, I, plain_codec<YGOR_SINGLE_PRECISION> >;
+        case YGOR_DOUBLE_PRECISION: return unpack_block_templ<C, I, plain_codec<YGOR_DOUBLE_PRECISION> >;
+        default: return NULL;
+    }
+}
+
+template <typename I>
+unpack_block_func_t
+unpack_block_func_indep(const ygor_series* s, uint64_t encoding)
+{
+    return (encoding & YGOR_ENCODING_COLUMNAR)
+         ? unpack_block_func_layout<true, I>(s, encoding)
+         : unpack_block_func_layout<false, I>(s, encoding);
+}
+
+pack_block_func_t
+ygor_series_logger :: pack_block_func(const ygor_series* s, unsigned encoding)
+{
+    if (!encoding || (encoding & ENCODING_HISTOGRAM))
+    {
+        return NULL;
+    }
+
+    if (encoding & YGOR_ENCODING_DELTA_OF_DELTA)
+    {
+        return pack_block_func_indep<dod_codec>(s, encoding);
+    }
+
+    switch (s->indep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return pack_block_func_indep<delta_codec>(s, encoding);
+        case YGOR_HALF_PRECISION: return pack_block_func_indep<plain_codec<YGOR_HALF_PRECISION> >(s, encoding);
+        case YGOR_SINGLE_PRECISION: return pack_block_func_indep<plain_codec<YGOR_SINGLE_PRECISION> >(s, encoding);
+        case YGOR_DOUBLE_PRECISION: return pack_block_func_indep<plain_codec<YGOR_DOUBLE_PRECISION> >(s, encoding);
+        default: return NULL;
+    }
+}
+
+ygor_series_logger :: ygor_series_logger(ygor_data_logger* dl, const ygor_series* s, const series_options& so)
+    : ydl(dl)
+    , ys(s)
+    , sindex(ydl->series_index(ys))
+    , sampling(so.sampling)
+    , sampling_n(so.sampling_n)
+    , sampling_interval(so.sampling_interval)
+    , sample_seen(0)
+    , sample_state(0)
+    , points_mtx()
+    , points(NULL)
+    , points_sz(0)
+    , io_mtx()
+    , spare(NULL)
+    , writing(0)
+    , encoding(so.histogram_interval ? ENCODING_HISTOGRAM : so.encoding)
+    , sort(sort_func(ys))
+    , pack(pack_func(ys))
+    , pack_block(pack_block_func(ys, encoding))
+    , sort_scratch()
+    , io_buf()
+    , hist_interval(so.histogram_interval)
+    , hist(hist_interval ? new histogram(so.histogram_precision) : NULL)
+    , hist_window(0)
+    , hist_summary()
+{
+}
+
+ygor_series_logger :: ~ygor_series_logger() throw ()
+{
+    // blocks belong to the logger's pool
+    delete hist;
+}
+
+bool
+ygor_series_logger :: sample(const ygor_data_value& indep)
+{
+    switch (sampling)
+    {
+        case YGOR_SAMPLING_ONE_IN_N:
+            return (e::atomic::increment_64_nobarrier(&sample_seen, 1) - 1) % sampling_n == 0;
+        case YGOR_SAMPLING_RESERVOIR:
+        {
+            const uint64_t seen = e::atomic::increment_64_nobarrier(&sample_seen, 1) - 1;
+            const uint64_t run = seen / sampling_n;
+            const uint64_t tag = (run + 1) & UINT32_MAX;
+            uint64_t state = e::atomic::load_64_nobarrier(&sample_state);
+
+            // every thread draws the same point for a run, so whichever
+            // caches it first does no harm to the others
+            if ((state >> 32) != tag)
+            {
+                uint32_t r[16];
+                guacamole_mash((uint64_t(sindex) << 48) ^ run, r);
+                state = (tag << 32) | ((uint64_t(r[0]) * sampling_n) >> 32);
+                e::atomic::store_64_nobarrier(&sample_state, state);
+            }
+
+            return seen % sampling_n == (state & UINT32_MAX);
+        }
+        case YGOR_SAMPLING_THROTTLE:
+        {
+            const uint64_t tag = (indep.precise / sampling_interval) & UINT32_MAX;
+            uint64_t state = e::atomic::load_64_nobarrier(&sample_state);
+
+            while (true)
+            {
+                uint64_t next;
+
+                // points that arrive late count against the current interval
+                if (int32_t(tag - (state >> 32)) > 0)
+                {
+                    next = (tag << 32) | 1;
+                }
+                else if ((state & UINT32_MAX) < sampling_n)
+                {
+                    next = state + 1;
+                }
+                else
+                {
+                    return false;
+                }
+
+                const uint64_t witness = e::atomic::compare_and_swap_64_nobarrier(&sample_state, state, next);
+
+                if (witness == state)
+                {
+                    return true;
+                }
+
+                state = witness;
+            }
+        }
+        default:
+            return true;
+    }
+}
+
+uint64_t
+ygor_series_logger :: sampling_ratio() const
+{
+    return sampling == YGOR_SAMPLING_ONE_IN_N ||
+           sampling == YGOR_SAMPLING_RESERVOIR ? sampling_n : 0;
+}
+
+int
+ygor_series_logger :: record(ygor_data_point* ydp)
+{
+    points_mtx.lock();
+
+    if (!points)
+    {
+        points = ydl->allocate_block();
+    }
+
+    assert(points_sz < ydl->block_size);
+    points[points_sz] = *ydp;
+    ++points_sz;
+
+    if (points_sz < ydl->block_size)
+    {
+        points_mtx.unlock();
+        return 0;
+    }
+
+    return hand_off_full();
+}
+
+template <typename B>
+int
+ygor_series_logger :: record_batch(const B& batch, size_t batch_sz)
+{
+    int ret = 0;
+
+    for (size_t off = 0; off < batch_sz; )
+    {
+        points_mtx.lock();
+
+        if (!points)
+        {
+            points = ydl->allocate_block();
+        }
+
+        assert(points_sz < ydl->block_size);
+        const size_t n = std::min(batch_sz - off, ydl->block_size - points_sz);
+        batch.copy(off, n, points + points_sz);
+        points_sz += n;
+        off += n;
+
+        if (points_sz < ydl->block_size)
+        {
+            points_mtx.unlock();
+            break;
+        }
+
+        if (hand_off_full() < 0)
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int
+ygor_series_logger :: hand_off_full()
+{
+    const size_t block_size = ydl->block_size;
+    assert(points_sz == block_size);
+
+    if (ydl->writer_thread)
+    {
+        int ret = ydl->hand_off(this, &points, block_size, true);
+        points_sz = 0;
+        points_mtx.unlock();
+        return ret;
+    }
+
+    // rather than wait for the other block to be written, drop this one
+    if (ydl->drop_on_overload && !claim_write())
+    {
+        ydl->count_dropped(block_size);
+        points_sz = 0;
+        points_mtx.unlock();
+        return 0;
+    }
+
+    int ret = 0;
+
+    {
+        po6::threads::mutex::hold hold(&io_mtx);
+        ygor_data_point* flush = points;
+        points = spare ? spare : ydl->allocate_block();
+        spare = NULL;
+        points_sz = 0;
+        points_mtx.unlock();
+        ret = write(flush, block_size);
+        spare = flush;
+    }
+
+    if (ydl->drop_on_overload)
+    {
+        release_write();
+    }
+
+    return ret;
+}
+
+bool
+ygor_series_logger :: claim_write()
+{
+    return e::atomic::compare_and_swap_32_nobarrier(&writing, 0, 1) == 0;
+}
+
+void
+ygor_series_logger :: release_write()
+{
+    e::atomic::store_32_release(&writing, 0);
+}
+
+int
+ygor_series_logger :: flush()
+{
+    po6::threads::mutex::hold holdp(&points_mtx);
+
+    int ret = 0;
+
+    if (ydl->writer_thread)
+    {
+        ret = points_sz > 0 ? ydl->hand_off(this, &points, points_sz, false) : 0;
+        points_sz = 0;
+    }
+    else
+    {
+        po6::threads::mutex::hold holdi(&io_mtx);
+        ret = write(points, points_sz);
+        points_sz = 0;
+
+        if (spare)
+        {
+            ydl->release_block(spare);
+            spare = NULL;
+        }
+    }
+
+    if (points)
+    {
+        ydl->release_block(points);
+        points = NULL;
+    }
+
+    return ret;
+}
+
+int
+ygor_series_logger :: write(ygor_data_point* flush, size_t flush_sz)
+{
+    if (flush_sz == 0)
+    {
+        return 0;
+    }
+
+    sort(flush, flush_sz, &sort_scratch);
+
+    if (hist)
+    {
+        return aggregate(flush, flush_sz);
+    }
+
+    if (io_buf.empty())
+    {
+        io_buf.resize(sizeof(uint64_t) + 2 * VARINT_64_MAX_SIZE + ydl->block_size * MAX_POINT_SIZE + 1);
+    }
+
+    unsigned char* const buf = &io_buf[0];
+    unsigned char* ptr = buf + sizeof(uint64_t);
+    ptr = e::packvarint64(sindex, ptr);
+
+    if (pack_block)
+    {
+        ptr = pack_block(flush, flush_sz, ptr);
+    }
+    else
+    {
+        for (size_t i = 0; i < flush_sz; ++i)
+        {
+            ptr = pack(i > 0 ? flush + i - 1 : NULL, flush + i, ptr);
+        }
+    }
+
+    size_t buf_sz = ptr - buf;
+    e::pack64be(buf_sz - sizeof(uint64_t), buf);
+    // points are sorted, so the ends of the block are its extremes; the index
+    // describes them as readers will decode them, not as they were recorded
+    const ygor_data_value lo = quantize(ys->indep_precision, flush[0].indep);
+    const ygor_data_value hi = quantize(ys->indep_precision, flush[flush_sz - 1].indep);
+    uint64_t min;
+    uint64_t max;
+    memcpy(&min, &lo, sizeof(min));
+    memcpy(&max, &hi, sizeof(max));
+    block_summary summary;
+
+    for (size_t i = 0; i < flush_sz; ++i)
+    {
+        summary.add(value_to_double(ys->indep_precision, quantize(ys->indep_precision, flush[i].indep)),
+                    value_to_double(ys->dep_precision, quantize(ys->dep_precision, flush[i].dep)), 1);
+    }
+
+    return ydl->write_block(buf, buf_sz, this, flush_sz, min, max, summary);
+}
+
+int
+ygor_series_logger :: aggregate(const ygor_data_point* flush, size_t flush_sz)
+{
+    int ret = 0;
+
+    for (size_t i = 0; i < flush_sz; ++i)
+    {
+        const uint64_t window = flush[i].indep.precise / hist_interval;
+
+        // blocks from different threads may overlap in time, so a window can
+        // be written more than once; readers simply see more points for it
+        if (window != hist_window && !hist->empty() && write_snapshot() < 0)
+        {
+            ret = -1;
+        }
+
+        hist_window = window;
+        hist->add(flush[i].dep.precise);
+        hist_summary.add(flush[i].indep.precise, flush[i].dep.precise, 1);
+    }
+
+    return ret;
+}
+
+int
+ygor_series_logger :: write_snapshot()
+{
+    const uint64_t start = hist_window * hist_interval;
+    const size_t sz = sizeof(uint64_t) + 2 * VARINT_64_MAX_SIZE + hist->pack_size();
+
+    if (io_buf.size() < sz)
+    {
+        io_buf.resize(sz);
+    }
+
+    unsigned char* const buf = &io_buf[0];
+    unsigned char* ptr = buf + sizeof(uint64_t);
+    ptr = e::packvarint64(sindex, ptr);
+    ptr = e::packvarint64(start, ptr);
+    ptr = hist->pack(ptr);
+    size_t buf_sz = ptr - buf;
+    e::pack64be(buf_sz - sizeof(uint64_t), buf);
+    const uint64_t count = hist->nonzero();
+    const block_summary summary = hist_summary;
+    hist->clear();
+    hist_summary = block_summary();
+    return ydl->write_block(buf, buf_sz, this, count, start, start, summary);
+}
+
+int
+ygor_series_logger :: finish()
+{
+    return hist && !hist->empty() ? write_snapshot() : 0;
+}
+
+// One file of the input.  Output written with segment rollover is a sequence
+// of files that each stand alone, and that are read one after another as if
+// they were one.
+struct data_segment
+{
+    data_segment(const std::string& input);
+    ~data_segment() throw ();
+
+    bool init();
+    bool read_config(FILE* fin);
+    void read_index(FILE* fin);
+    void map(int fd);
+    bool same_series(const data_segment& other) const;
+
+    std::string input;
+    // whether init succeeded
+    bool ok;
+    off_t data_offset;
+    std::vector<ygor_series> series;
+    std::list<std::string> names;
+    // from the config block; files without one use the defaults
+    std::vector<uint64_t> block_sizes;
+    std::vector<uint64_t> encodings;
+    std::vector<uint64_t> histogram_precisions;
+    std::vector<uint64_t> sampling_ratios;
+    std::vector<uint64_t> cycles_per_second;
+    // from the index, when the file has one: each series' blocks in order
+    bool indexed;
+    std::vector<std::vector<index_entry> > blocks;
+    // the whole file, for iterators to decode in place; NULL to read blocks
+    // with stdio instead
+    const unsigned char* mapped;
+    size_t mapped_sz;
+
+    private:
+        data_segment(const data_segment&);
+        data_segment& operator = (const data_segment&);
+};
+
+struct ygor_data_reader
+{
+    ygor_data_reader();
+    ~ygor_data_reader() throw ();
+
+    bool init(const char* input);
+
+    std::vector<data_segment*> segments;
+    // the first segment's series, which every other segment repeats
+    std::vector<ygor_series> series;
+    // how many threads iterators over the reader may scan blocks with
+    unsigned scan_threads;
+
+    private:
+        ygor_data_reader(const ygor_data_reader&);
+        ygor_data_reader& operator = (const ygor_data_reader&);
+};
+
+static void
+data_segment_init(std::vector<data_segment*>* segments, size_t first, size_t stride)
+{
+    for (size_t i = first; i < segments->size(); i += stride)
+    {
+        (*segments)[i]->ok = (*segments)[i]->init();
+    }
+}
+
+YGOR_API ygor_data_reader*
+ygor_data_reader_create(const char* input)
+{
+    ygor_data_reader* ydr = new ygor_data_reader();
+
+    if (!ydr->init(input))
+    {
+        delete ydr;
+        return NULL;
+    }
+
+    return ydr;
+}
+
+YGOR_API void
+ygor_data_reader_destroy(ygor_data_reader* ydr)
+{
+    delete ydr;
+}
+
+YGOR_API int
+ygor_data_reader_threads(ygor_data_reader* ydr, long threads)
+{
+    if (threads < 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ydr->scan_threads = std::min(threads, long(MAX_SCAN_THREADS));
+    return 0;
+}
+
+YGOR_API uint64_t
+ygor_data_reader_cycles_per_second(ygor_data_reader* ydr, size_t idx)
+{
+    return ydr->segments[0]->cycles_per_second[idx];
+}
+
+YGOR_API size_t
+ygor_data_reader_num_series(ygor_data_reader* ydr)
+{
+    return ydr->series.size();
+}
+
+YGOR_API const ygor_series*
+ygor_data_reader_series(ygor_data_reader* ydr, size_t idx)
+{
+    return &ydr->series[idx];
+}
+
+ygor_data_reader :: ygor_data_reader()
+    : segments()
+    , series()
+    , scan_threads(1)
+{
+}
+
+ygor_data_reader :: ~ygor_data_reader() throw ()
+{
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        delete segments[i];
+    }
+}
+
+// The input is either one file, or the base name of a set of segments.
+bool
+ygor_data_reader :: init(const char* input)
+{
+    if (access(input, F_OK) == 0)
+    {
+        segments.push_back(new data_segment(input));
+    }
+    else
+    {
+        for (unsigned i = 0; ; ++i)
+        {
+            std::string name(segment_name(input, i));
+
+            if (access(name.c_str(), F_OK) < 0)
+            {
+                break;
+            }
+
+            segments.push_back(new data_segment(name));
+        }
+    }
+
+    if (segments.empty())
+    {
+        errno = ENOENT;
+        return false;
+    }
+
+    // read the segments' headers and indices concurrently; a long recording
+    // may have many of them
+    const size_t threads_sz = std::min(segments.size(), size_t(SEGMENT_READER_THREADS));
+
+    if (threads_sz == 1)
+    {
+        data_segment_init(&segments, 0, 1);
+    }
+    else
+    {
+        std::vector<po6::threads::thread*> threads;
+
+        for (size_t i = 0; i < threads_sz; ++i)
+        {
+            threads.push_back(new po6::threads::thread(po6::threads::make_func(&data_segment_init, &segments, i, threads_sz)));
+            threads.back()->start();
+        }
+
+        for (size_t i = 0; i < threads.size(); ++i)
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+    }
+
+    // the last segment of a recording that did not finish may be cut off
+    // before its header was written
+    if (segments.size() > 1 && !segments.back()->ok)
+    {
+        delete segments.back();
+        segments.pop_back();
+    }
+
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        if (!segments[i]->ok || !segments[i]->same_series(*segments[0]))
+        {
+            return false;
+        }
+    }
+
+    series = segments[0]->series;
+    return true;
+}
+
+data_segment :: data_segment(const std::string& i)
+    : input(i)
+    , ok(false)
+    , data_offset(0)
+    , series()
+    , names()
+    , block_sizes()
+    , encodings()
+    , histogram_precisions()
+    , sampling_ratios()
+    , cycles_per_second()
+    , indexed(false)
+    , blocks()
+    , mapped(NULL)
+    , mapped_sz(0)
+{
+}
+
+data_segment :: ~data_segment() throw ()
+{
+    if (mapped)
+    {
+        munmap(const_cast<unsigned char*>(mapped), mapped_sz);
+    }
+}
+
+bool
+data_segment :: init()
+{
+    FILE* fin = fopen(input.c_str(), "r");
+
+    if (!fin)
+    {
+        return false;
+    }
+
+    e::guard g_fin = e::makeguard(fclose, fin);
+    char buffer[512];
+    size_t used = 0;
+
+    while (true)
+    {
+        char* ptr = (char*)memchr(buffer, '\0', used);
+
+        if (!ptr && feof(fin))
+        {
+            return false;
+        }
+        else if (!ptr)
+        {
+            size_t amt = fread(buffer + used, 1, 512 - used, fin);
+
+            if (amt == 0 || ferror(fin))
+            {
+                return false;
+            }
+
+            used += amt;
         }
         else if (ptr == buffer)
         {
-            data_offset = ftell(fin) - used + 1;
+            data_offset = ftell(fin) - used + 1;
+            if (!read_config(fin))
+            {
+                return false;
+            }
+
+            read_index(fin);
+
+            // a file with an index was closed, and will not be truncated
+            // under the mapping as a preallocated file being written may be
+            if (indexed)
+            {
+                map(fileno(fin));
+            }
+
+            return true;
+        }
+        else if (ptr + 4 > buffer + used)
+        {
+            return false;
+        }
+        else
+        {
+            names.push_back(buffer);
+            series.push_back(ygor_series());
+            series.back().name = names.back().c_str();
+            series.back().indep_units = (ygor_units)ptr[1];
+            series.back().indep_precision = (ygor_precision)ptr[2];
+            series.back().dep_units = (ygor_units)ptr[3];
+            series.back().dep_precision = (ygor_precision)ptr[4];
+
+            char* tmp = ptr + 5;
+            size_t rem = tmp - buffer;
+            memmove(buffer, tmp, used - rem);
+            used -= rem;
+        }
+    }
+}
+
+bool
+data_segment :: read_config(FILE* fin)
+{
+    block_sizes.resize(series.size(), SERIES_BUFFER_SIZE);
+    encodings.resize(series.size(), 0);
+    histogram_precisions.resize(series.size(), 0);
+    sampling_ratios.resize(series.size(), 0);
+    cycles_per_second.resize(series.size(), 0);
+    unsigned char hdr[sizeof(uint64_t)];
+
+    // files written before the config block was introduced start directly
+    // with data blocks (or are empty)
+    if (fseek(fin, data_offset, SEEK_SET) < 0 ||
+        fread(hdr, 1, sizeof(hdr), fin) != sizeof(hdr))
+    {
+        return !ferror(fin);
+    }
+
+    uint64_t block_sz;
+    e::unpack64be(hdr, &block_sz);
+
+    if (block_sz == 0)
+    {
+        return true;
+    }
+
+    std::vector<unsigned char> buf(std::min(block_sz, uint64_t(VARINT_64_MAX_SIZE)));
+
+    if (fread(&buf[0], 1, buf.size(), fin) != buf.size())
+    {
+        return false;
+    }
+
+    const unsigned char* ptr = &buf[0];
+    const unsigned char* end = ptr + buf.size();
+    uint64_t tag;
+    ptr = e::varint64_decode(ptr, end, &tag);
+
+    if (!ptr || tag != CONFIG_BLOCK)
+    {
+        return ptr != NULL;
+    }
+
+    // a corrupt length must not become an arbitrarily large allocation
+    if (block_sz > MAX_BLOCK_BYTES)
+    {
+        return false;
+    }
+
+    buf.resize(block_sz);
+
+    if (fseek(fin, data_offset + sizeof(uint64_t), SEEK_SET) < 0 ||
+        fread(&buf[0], 1, buf.size(), fin) != buf.size())
+    {
+        return false;
+    }
+
+    ptr = e::varint64_decode(&buf[0], &buf[0] + buf.size(), &tag);
+    end = &buf[0] + buf.size();
+
+    while (ptr && ptr < end)
+    {
+        uint64_t key;
+        uint64_t idx;
+        uint64_t value;
+        ptr = e::varint64_decode(ptr, end, &key);
+        ptr = ptr ? e::varint64_decode(ptr, end, &idx) : NULL;
+        ptr = ptr ? e::varint64_decode(ptr, end, &value) : NULL;
+
+        if (!ptr || idx >= series.size())
+        {
+            return false;
+        }
+
+        // unknown keys are from newer writers; iterators refuse series whose
+        // encoding they do not know, and anything else is safe to ignore
+        switch (key)
+        {
+            case CONFIG_BLOCK_SIZE:
+                block_sizes[idx] = value;
+                break;
+            case CONFIG_ENCODING:
+                encodings[idx] = value;
+                break;
+            case CONFIG_HISTOGRAM_PRECISION:
+                histogram_precisions[idx] = value;
+                break;
+            case CONFIG_SAMPLING_RATIO:
+                sampling_ratios[idx] = value;
+                break;
+            case CONFIG_CYCLES_PER_SECOND:
+                cycles_per_second[idx] = value;
+                break;
+            default:
+                break;
+        }
+    }
+
+    data_offset += sizeof(uint64_t) + block_sz;
+    return ptr != NULL;
+}
+
+// A file without a usable index (one that was never closed, or written before
+// the index existed) is still read by scanning every block.
+void
+data_segment :: read_index(FILE* fin)
+{
+    if (fseek(fin, 0, SEEK_END) < 0)
+    {
+        return;
+    }
+
+    const long file_sz = ftell(fin);
+    unsigned char trailer[TRAILER_SIZE];
+
+    if (file_sz < data_offset + long(TRAILER_SIZE) ||
+        fseek(fin, file_sz - TRAILER_SIZE, SEEK_SET) < 0 ||
+        fread(trailer, 1, TRAILER_SIZE, fin) != TRAILER_SIZE)
+    {
+        return;
+    }
+
+    const unsigned char* ptr = trailer;
+    const unsigned char* end = trailer + TRAILER_SIZE;
+    uint64_t trailer_sz;
+    uint64_t tag;
+    uint64_t chunk;
+    ptr = e::unpack64be(ptr, &trailer_sz);
+    ptr = e::varint64_decode(ptr, end, &tag);
+
+    if (trailer_sz != TRAILER_SIZE - sizeof(uint64_t) || !ptr ||
+        tag != TRAILER_BLOCK || end - ptr != sizeof(uint64_t) + sizeof(INDEX_MAGIC))
+    {
+        return;
+    }
+
+    ptr = e::unpack64be(ptr, &chunk);
+
+    if (memcmp(ptr, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+    {
+        return;
+    }
+
+    // chunks are chained from last to first
+    std::vector<std::vector<index_entry> > chunks;
+    std::vector<unsigned char> buf;
+    uint64_t next = chunk + 1;
+
+    while (next > 0)
+    {
+        chunk = next - 1;
+        unsigned char hdr[sizeof(uint64_t)];
+        uint64_t chunk_sz;
+
+        if (chunk < uint64_t(data_offset) || chunk >= uint64_t(file_sz) ||
+            fseek(fin, chunk, SEEK_SET) < 0 ||
+            fread(hdr, 1, sizeof(hdr), fin) != sizeof(hdr))
+        {
+            return;
+        }
+
+        e::unpack64be(hdr, &chunk_sz);
+
+        if (chunk_sz == 0 || chunk_sz > MAX_BLOCK_BYTES)
+        {
+            return;
+        }
+
+        buf.resize(chunk_sz);
+
+        if (fread(&buf[0], 1, chunk_sz, fin) != chunk_sz)
+        {
+            return;
+        }
+
+        ptr = &buf[0];
+        end = ptr + chunk_sz;
+        uint64_t entries_sz = 0;
+        ptr = e::varint64_decode(ptr, end, &tag);
+        ptr = ptr ? e::varint64_decode(ptr, end, &next) : NULL;
+        ptr = ptr ? e::varint64_decode(ptr, end, &entries_sz) : NULL;
+
+        // each chunk must point strictly backwards
+        if (!ptr || tag != INDEX_BLOCK || next > chunk ||
+            entries_sz > INDEX_CHUNK_ENTRIES)
+        {
+            return;
+        }
+
+        chunks.push_back(std::vector<index_entry>(entries_sz));
+
+        for (size_t i = 0; i < entries_sz; ++i)
+        {
+            index_entry* ie = &chunks.back()[i];
+            ptr = ptr ? e::varint64_decode(ptr, end, &ie->series) : NULL;
+            ptr = ptr ? e::varint64_decode(ptr, end, &ie->offset) : NULL;
+            ptr = ptr ? e::varint64_decode(ptr, end, &ie->count) : NULL;
+
+            if (!ptr || end - ptr < 2 * ptrdiff_t(sizeof(uint64_t)) ||
+                ie->series >= series.size() || ie->offset >= chunk)
+            {
+                return;
+            }
+
+            ptr = e::unpack64be(ptr, &ie->min);
+            ptr = e::unpack64be(ptr, &ie->max);
+            block_summary* bs = &ie->summary;
+            ptr = e::varint64_decode(ptr, end, &bs->count);
+
+            if (!ptr || end - ptr < 6 * ptrdiff_t(sizeof(double)))
+            {
+                return;
+            }
+
+            ptr = e::unpackdoublebe(ptr, &bs->indep_sum);
+            ptr = e::unpackdoublebe(ptr, &bs->indep_sumsq);
+            ptr = e::unpackdoublebe(ptr, &bs->dep_min);
+            ptr = e::unpackdoublebe(ptr, &bs->dep_max);
+            ptr = e::unpackdoublebe(ptr, &bs->dep_sum);
+            ptr = e::unpackdoublebe(ptr, &bs->dep_sumsq);
+        }
+    }
+
+    blocks.resize(series.size());
+
+    for (size_t i = chunks.size(); i > 0; --i)
+    {
+        for (size_t j = 0; j < chunks[i - 1].size(); ++j)
+        {
+            const index_entry& ie(chunks[i - 1][j]);
+            blocks[ie.series].push_back(ie);
+        }
+    }
+
+    indexed = true;
+}
+
+void
+data_segment :: map(int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || st.st_size <= 0)
+    {
+        return;
+    }
+
+    void* m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (m == MAP_FAILED)
+    {
+        return;
+    }
+
+    madvise(m, st.st_size, MADV_SEQUENTIAL);
+    mapped = static_cast<const unsigned char*>(m);
+    mapped_sz = st.st_size;
+}
+
+bool
+data_segment :: same_series(const data_segment& other) const
+{
+    if (series.size() != other.series.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < series.size(); ++i)
+    {
+        if (strcmp(series[i].name, other.series[i].name) != 0 ||
+            series[i].indep_units != other.series[i].indep_units ||
+            series[i].indep_precision != other.series[i].indep_precision ||
+            series[i].dep_units != other.series[i].dep_units ||
+            series[i].dep_precision != other.series[i].dep_precision)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// An analysis that iterators feed a block at a time, possibly from several
+// threads at once.  Each thread feeds a partial of its own, and the partials
+// are merged back into the scan when every block has been fed.
+struct block_scan
+{
+    block_scan();
+    virtual ~block_scan() throw ();
+
+    virtual block_scan* partial() = 0;
+    // account for a block from its index entry alone, as peek_block describes
+    // it; false to be fed its points instead
+    virtual bool entry(const index_entry& ie);
+    // weights is never NULL
+    virtual void points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz) = 0;
+    // fold in (and leave empty) a partial made by partial()
+    virtual void merge(block_scan* other) = 0;
+
+    private:
+        block_scan(const block_scan&);
+        block_scan& operator = (const block_scan&);
+};
+
+block_scan :: block_scan()
+{
+}
+
+block_scan :: ~block_scan() throw ()
+{
+}
+
+bool
+block_scan :: entry(const index_entry&)
+{
+    return false;
+}
+
+struct ygor_data_iterator
+{
+    ygor_data_iterator();
+    virtual ~ygor_data_iterator() throw ();
+
+    virtual ygor_series* series() = 0;
+    virtual int valid() = 0;
+    virtual void advance() = 0;
+    virtual void read(ygor_data_point* ydp) = 0;
+    virtual int rewind() = 0;
+    // Start over at the first point whose independent value is at least
+    // indep.  Iterators over indexed files pass over whole blocks that end
+    // before it without reading them.
+    virtual int seek(uint64_t indep);
+    // a hint that the caller reads only dependent values; iterators may then
+    // leave the independent values of points they read zeroed
+    virtual void skip_indep(bool skip);
+    // the number of recorded values the current point stands for; weighted
+    // series (histograms) vary it from point to point, while sampled series
+    // give every point the same weight and are not weighted, as a uniform
+    // weight leaves quantiles unchanged
+    virtual bool weighted();
+    virtual uint64_t weight();
+    // the rate recorded for a series in cycles, or zero if there is none
+    virtual uint64_t cycles_per_second();
+    // Copy up to max of the points left in the current block (and their
+    // weights, unless weights is NULL) and advance past them.  Returns how
+    // many were copied, zero at the end, and -1 on error.
+    virtual int64_t read_batch(ygor_data_point* ydp, uint64_t* weights, size_t max);
+    // read_batch by columns; indep may be NULL, and approximate independent
+    // values are rounded down
+    virtual int64_t read_columns(uint64_t* indep, double* dep, uint64_t* weights, size_t max);
+    // Between blocks, iterators over indexed files may describe the next
+    // block before decoding it.  When peek_block succeeds, the caller may
+    // skip_block to pass over the block entirely.  The entry's min and max
+    // (and summary) are in the units and precision of the iterator's series.
+    virtual bool peek_block(index_entry* ie);
+    virtual void skip_block();
+    // Feed the rest of the iterator's points to bs, leaving it at the end.
+    // The blocks of a series may be fed out of order.
+    virtual int scan(block_scan* bs);
+};
+
+ygor_data_iterator :: ygor_data_iterator()
+{
+}
+
+ygor_data_iterator :: ~ygor_data_iterator() throw ()
+{
+}
+
+// Advance past the points before indep, one at a time
+static int
+seek_points(ygor_data_iterator* ydi, uint64_t indep)
+{
+    const ygor_precision p = ydi->series()->indep_precision;
+    int status = 0;
+
+    while ((status = ydi->valid()) > 0)
+    {
+        ygor_data_point ydp;
+        ydi->read(&ydp);
+
+        if (!indep_before(p, ydp.indep, indep))
+        {
+            break;
+        }
+
+        ydi->advance();
+    }
+
+    return status < 0 ? -1 : 0;
+}
+
+int
+ygor_data_iterator :: seek(uint64_t indep)
+{
+    if (rewind() < 0)
+    {
+        return -1;
+    }
+
+    return seek_points(this, indep);
+}
+
+void
+ygor_data_iterator :: skip_indep(bool)
+{
+}
+
+bool
+ygor_data_iterator :: weighted()
+{
+    return false;
+}
+
+uint64_t
+ygor_data_iterator :: weight()
+{
+    return 1;
+}
+
+uint64_t
+ygor_data_iterator :: cycles_per_second()
+{
+    return 0;
+}
+
+int64_t
+ygor_data_iterator :: read_batch(ygor_data_point* ydp, uint64_t* weights, size_t max)
+{
+    int status = 0;
+    size_t n = 0;
+
+    while (n < max && (status = valid()) > 0)
+    {
+        read(ydp + n);
+
+        if (weights)
+        {
+            weights[n] = weight();
+        }
+
+        advance();
+        ++n;
+    }
+
+    return n > 0 ? int64_t(n) : status;
+}
+
+int64_t
+ygor_data_iterator :: read_columns(uint64_t* indep, double* dep, uint64_t* weights, size_t max)
+{
+    const ygor_series* s = series();
+    int status = 0;
+    size_t n = 0;
+
+    while (n < max && (status = valid()) > 0)
+    {
+        ygor_data_point p;
+        read(&p);
+
+        if (indep)
+        {
+            indep[n] = ygor_is_precise(s->indep_precision) ? p.indep.precise : uint64_t(p.indep.approximate);
+        }
+
+        dep[n] = value_to_double(s->dep_precision, p.dep);
+
+        if (weights)
+        {
+            weights[n] = weight();
+        }
+
+        advance();
+        ++n;
+    }
+
+    return n > 0 ? int64_t(n) : status;
+}
+
+bool
+ygor_data_iterator :: peek_block(index_entry*)
+{
+    return false;
+}
+
+void
+ygor_data_iterator :: skip_block()
+{
+    abort();
+}
+
+int
+ygor_data_iterator :: scan(block_scan* bs)
+{
+    std::vector<ygor_data_point> points(READ_BATCH_SIZE);
+    std::vector<uint64_t> weights(READ_BATCH_SIZE);
+
+    while (true)
+    {
+        index_entry ie;
+
+        if (peek_block(&ie) && bs->entry(ie))
+        {
+            skip_block();
+            continue;
+        }
+
+        const int64_t n = read_batch(&points[0], &weights[0], READ_BATCH_SIZE);
+
+        if (n <= 0)
+        {
+            return n < 0 ? -1 : 0;
+        }
+
+        bs->points(&points[0], &weights[0], n);
+    }
+}
+
+// Marks an iterator as read for its dependent values only, for the duration
+// of one analysis.
+struct dep_only
+{
+    dep_only(ygor_data_iterator* ydi);
+    ~dep_only() throw ();
+
+    ygor_data_iterator* m_ydi;
+
+    private:
+        dep_only(const dep_only&);
+        dep_only& operator = (const dep_only&);
+};
+
+dep_only :: dep_only(ygor_data_iterator* ydi)
+    : m_ydi(ydi)
+{
+    m_ydi->skip_indep(true);
+}
+
+dep_only :: ~dep_only() throw ()
+{
+    m_ydi->skip_indep(false);
+}
+
+// One block of a series for a parallel scan to decode: where it lies, and its
+// index entry if the segment has an index
+struct scan_block
+{
+    scan_block();
+    scan_block(size_t segment, uint64_t offset, const index_entry* entry);
+
+    size_t segment;
+    uint64_t offset;
+    const index_entry* entry;
+};
+
+scan_block :: scan_block()
+    : segment(0)
+    , offset(0)
+    , entry(NULL)
+{
+}
+
+scan_block :: scan_block(size_t s, uint64_t o, const index_entry* e)
+    : segment(s)
+    , offset(o)
+    , entry(e)
+{
+}
+
+struct series_iterator : public ygor_data_iterator
+{
+    static unpack_func_t unpack_func(ygor_series* s);
+    static unpack_block_func_t unpack_block_func(ygor_series* s, uint64_t encoding);
+
+    series_iterator();
+    virtual ~series_iterator() throw ();
+
+    virtual ygor_series* series();
+    virtual int valid();
+    virtual void advance();
+    virtual void read(ygor_data_point* ydp);
+    virtual int rewind();
+    virtual int seek(uint64_t indep);
+    virtual void skip_indep(bool skip);
+    virtual bool weighted();
+    virtual uint64_t weight();
+    virtual uint64_t cycles_per_second();
+    virtual int64_t read_batch(ygor_data_point* ydp, uint64_t* weights, size_t max);
+    virtual int64_t read_columns(uint64_t* indep, double* dep, uint64_t* weights, size_t max);
+    virtual bool peek_block(index_entry* ie);
+    virtual void skip_block();
+    virtual int scan(block_scan* bs);
+
+    bool init(ygor_data_reader* ydr, size_t idx);
+    void bind(ygor_data_reader* ydr, size_t idx);
+    // apply a segment's configuration without opening it
+    bool configure(size_t segment);
+    bool open_segment(size_t segment);
+    bool next_segment();
+    // the next buf_sz bytes of the segment, in place when it is mapped and
+    // otherwise read into m_buf; NULL at the end or on error
+    const unsigned char* read(size_t buf_sz);
+    bool seek_offset(uint64_t offset);
+    // decode a block of the series (after its series number) into m_data
+    bool decode(const unsigned char* ptr, const unsigned char* end);
+    bool unpack_snapshot(const unsigned char* in, const unsigned char* end);
+    // where the rest of the series' blocks lie, through to the last segment;
+    // the iterator is left at the end
+    bool find_blocks(std::vector<scan_block>* blocks);
+    // decode one block found by find_blocks and feed it to bs
+    bool scan_one(const scan_block& sb, block_scan* bs, std::vector<uint64_t>* weights);
+
+    ygor_data_reader* m_reader;
+    ygor_series* m_series;
+    size_t m_series_idx;
+    // the segment being read, and where its blocks begin
+    size_t m_segment;
+    FILE* m_input;
+    off_t m_offset;
+    // the segment's mapping, and the position in it, when m_input is NULL
+    const unsigned char* m_map;
+    size_t m_map_sz;
+    uint64_t m_map_pos;
+    // the series' blocks from the segment's index, or NULL to scan every block
+    const std::vector<index_entry>* m_blocks;
+    size_t m_blocks_idx;
+
+    std::vector<unsigned char> m_buf;
+    std::vector<ygor_data_point> m_data;
+    size_t m_data_idx;
+    bool m_primed;
+    bool m_error;
+    bool m_eof;
+    unpack_func_t m_unpack;
+    unpack_block_func_t m_unpack_block;
+    bool m_skip_indep;
+    // histogram series read one point per non-empty bucket, weighted by the
+    // bucket's count
+    unsigned m_precision;
+    std::vector<uint64_t> m_buckets;
+    std::vector<uint64_t> m_weights;
+    // sampled series weight every point by the sampling ratio
+    uint64_t m_sampling;
+
+    private:
+        series_iterator(const series_iterator&);
+        series_iterator& operator = (const series_iterator&);
+};
+
+YGOR_API ygor_data_iterator*
+ygor_data_iterate(ygor_data_reader* ydr, const char* name)
+{
+    size_t idx = 0;
+
+    for (idx = 0; idx < ydr->series.size(); ++idx)
+    {
+        if (strcmp(ydr->series[idx].name, name) == 0)
+        {
+            break;
+        }
+    }
+
+    if (idx == ydr->series.size())
+    {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    series_iterator* ydi = new series_iterator();
+
+    if (!ydi->init(ydr, idx))
+    {
+        delete ydi;
+        return NULL;
+    }
+
+    return ydi;
+}
+
+// The next sz bytes of a segment read in one pass, from its mapping or from
+// fin; NULL if fewer remain.
+static const unsigned char*
+segment_bytes(const data_segment* ds, FILE* fin, uint64_t* pos, size_t sz,
+              std::vector<unsigned char>* buf)
+{
+    if (ds->mapped)
+    {
+        if (*pos > ds->mapped_sz || sz > ds->mapped_sz - *pos)
+        {
+            return NULL;
+        }
+
+        const unsigned char* ptr = ds->mapped + *pos;
+        *pos += sz;
+        return ptr;
+    }
+
+    buf->resize(sz);
+
+    if (fread(&(*buf)[0], 1, sz, fin) != sz)
+    {
+        return NULL;
+    }
+
+    *pos += sz;
+    return &(*buf)[0];
+}
+
+// Walk one segment's blocks in the order they were written, decoding each
+// with the iterator of its series and handing it to f.
+static int
+iterate_segment(const data_segment* ds, const std::vector<series_iterator*>& its,
+                ygor_data_block_func f, void* arg)
+{
+    FILE* fin = NULL;
+
+    if (!ds->mapped &&
+        (!(fin = fopen(ds->input.c_str(), "r")) ||
+         fseek(fin, ds->data_offset, SEEK_SET) < 0))
+    {
+        if (fin)
+        {
+            fclose(fin);
+        }
+
+        return -1;
+    }
+
+    uint64_t pos = ds->data_offset;
+    std::vector<unsigned char> buf;
+    std::vector<uint64_t> weights;
+    int ret = 0;
+
+    while (true)
+    {
+        const unsigned char* hdr = segment_bytes(ds, fin, &pos, sizeof(uint64_t), &buf);
+
+        // the end of the file, or the preallocated but unwritten end of one
+        // still being written
+        if (!hdr)
+        {
+            ret = fin && ferror(fin) ? -1 : 0;
+            break;
+        }
+
+        uint64_t block_sz;
+        e::unpack64be(hdr, &block_sz);
+
+        if (block_sz == 0)
+        {
+            break;
+        }
+
+        const unsigned char* ptr = block_sz <= MAX_BLOCK_BYTES
+                                 ? segment_bytes(ds, fin, &pos, block_sz, &buf)
+                                 : NULL;
+
+        if (!ptr)
+        {
+            ret = -1;
+            break;
+        }
+
+        const unsigned char* end = ptr + block_sz;
+        uint64_t series;
+
+        if (!(ptr = e::varint64_decode(ptr, end, &series)))
+        {
+            ret = -1;
+            break;
+        }
+
+        // metadata
+        if (series >= its.size())
+        {
+            continue;
+        }
+
+        series_iterator* it = its[series];
+
+        if (!it->decode(ptr, end))
+        {
+            ret = -1;
+            break;
+        }
+
+        if (it->m_data.empty())
+        {
+            continue;
+        }
+
+        const uint64_t* w = NULL;
+
+        if (!it->m_weights.empty())
+        {
+            w = &it->m_weights[0];
+        }
+        else if (it->m_sampling > 1)
+        {
+            weights.assign(it->m_data.size(), it->m_sampling);
+            w = &weights[0];
+        }
+
+        if (f(arg, series, &it->m_data[0], w, it->m_data.size()) < 0)
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (fin)
+    {
+        fclose(fin);
+    }
+
+    return ret;
+}
+
+YGOR_API int
+ygor_data_iterate_all(ygor_data_reader* ydr, ygor_data_block_func f, void* arg)
+{
+    std::vector<series_iterator*> its(ydr->series.size());
+
+    for (size_t i = 0; i < its.size(); ++i)
+    {
+        its[i] = new series_iterator();
+        its[i]->bind(ydr, i);
+    }
+
+    int ret = 0;
+
+    for (size_t s = 0; ret == 0 && s < ydr->segments.size(); ++s)
+    {
+        for (size_t i = 0; ret == 0 && i < its.size(); ++i)
+        {
+            if (!its[i]->configure(s))
+            {
+                ret = -1;
+            }
+        }
+
+        if (ret == 0)
+        {
+            ret = iterate_segment(ydr->segments[s], its, f, arg);
+        }
+    }
+
+    for (size_t i = 0; i < its.size(); ++i)
+    {
+        delete its[i];
+    }
+
+    return ret;
+}
+
+YGOR_API void
+ygor_data_iterator_destroy(ygor_data_iterator* ydi)
+{
+    delete ydi;
+}
+
+YGOR_API const struct ygor_series*
+ygor_data_iterator_series(ygor_data_iterator* ydi)
+{
+    return ydi->series();
+}
+
+YGOR_API int
+ygor_data_iterator_valid(ygor_data_iterator* ydi)
+{
+    return ydi->valid();
+}
+
+YGOR_API void
+ygor_data_iterator_advance(ygor_data_iterator* ydi)
+{
+    return ydi->advance();
+}
+
+YGOR_API int
+ygor_data_iterator_rewind(ygor_data_iterator* ydi)
+{
+    return ydi->rewind();
+}
+
+YGOR_API int
+ygor_data_iterator_seek(ygor_data_iterator* ydi, uint64_t indep)
+{
+    return ydi->seek(indep);
+}
+
+YGOR_API void
+ygor_data_iterator_read(ygor_data_iterator* ydi, ygor_data_point* ydp)
+{
+    return ydi->read(ydp);
+}
+
+YGOR_API uint64_t
+ygor_data_iterator_weight(ygor_data_iterator* ydi)
+{
+    return ydi->weight();
+}
+
+YGOR_API int64_t
+ygor_data_iterator_read_batch(ygor_data_iterator* ydi, uint64_t* indep, double* dep, size_t max)
+{
+    return ydi->read_columns(indep, dep, NULL, max);
+}
+
+YGOR_API int64_t
+ygor_data_iterator_read_points(ygor_data_iterator* ydi, ygor_data_point* ydp,
+                               uint64_t* weights, size_t max)
+{
+    return ydi->read_batch(ydp, weights, max);
+}
+
+template <ygor_precision I, ygor_precision D>
+const unsigned char*
+unpack_func_templ(const unsigned char* in, const unsigned char* end, const ygor_data_point*, ygor_data_point* point)
+{
+    in = unpack_value_templ<I>(in, end, &point->indep);
+    return unpack_value_templ<D>(in, end, &point->dep);
+}
+
+const unsigned char*
+unpack_func_ipi(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+{
+    if (!in) return NULL;
+    in = e::varint64_decode(in, end, &point->indep.precise);
+
+    if (prev)
+    {
+        point->indep.precise += prev->indep.precise;
+    }
+
+    return in;
+}
+
+const unsigned char*
+unpack_func_pi_pi(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+{
+    in = unpack_func_ipi(in, end, prev, point);
+    return unpack_value_templ<YGOR_PRECISE_INTEGER>(in, end, &point->dep);
+}
+
+const unsigned char*
+unpack_func_pi_hp(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+{
+    in = unpack_func_ipi(in, end, prev, point);
+    return unpack_value_templ<YGOR_HALF_PRECISION>(in, end, &point->dep);
+}
+
+const unsigned char*
+unpack_func_pi_sp(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+{
+    in = unpack_func_ipi(in, end, prev, point);
+    return unpack_value_templ<YGOR_SINGLE_PRECISION>(in, end, &point->dep);
+}
+
+const unsigned char*
+unpack_func_pi_dp(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+{
+    in = unpack_func_ipi(in, end, prev, point);
+    return unpack_value_templ<YGOR_DOUBLE_PRECISION>(in, end, &point->dep);
+}
+
+unpack_func_t
+unpack_func_precise_integer(ygor_series* s)
+{
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return unpack_func_pi_pi;
+        case YGOR_HALF_PRECISION: return unpack_func_pi_hp;
+        case YGOR_SINGLE_PRECISION: return unpack_func_pi_sp;
+        case YGOR_DOUBLE_PRECISION: return unpack_func_pi_dp;
+        default: return NULL;
+    }
+}
+
+unpack_func_t
+unpack_func_half_precision(ygor_series* s)
+{
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return unpack_func_templ<YGOR_HALF_PRECISION, YGOR_PRECISE_INTEGER>;
+        case YGOR_HALF_PRECISION: return unpack_func_templ<YGOR_HALF_PRECISION, YGOR_HALF_PRECISION>;
+        case YGOR_SINGLE_PRECISION: return unpack_func_templ<YGOR_HALF_PRECISION, YGOR_SINGLE_PRECISION>;
+        case YGOR_DOUBLE_PRECISION: return unpack_func_templ<YGOR_HALF_PRECISION, YGOR_DOUBLE_PRECISION>;
+        default: return NULL;
+    }
+}
+
+unpack_func_t
+unpack_func_single_precision(ygor_series* s)
+{
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return unpack_func_templ<YGOR_SINGLE_PRECISION, YGOR_PRECISE_INTEGER>;
+        case YGOR_HALF_PRECISION: return unpack_func_templ<YGOR_SINGLE_PRECISION, YGOR_HALF_PRECISION>;
+        case YGOR_SINGLE_PRECISION: return unpack_func_templ<YGOR_SINGLE_PRECISION, YGOR_SINGLE_PRECISION>;
+        case YGOR_DOUBLE_PRECISION: return unpack_func_templ<YGOR_SINGLE_PRECISION, YGOR_DOUBLE_PRECISION>;
+        default: return NULL;
+    }
+}
+
+unpack_func_t
+unpack_func_double_precision(ygor_series* s)
+{
+    switch (s->dep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return unpack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_PRECISE_INTEGER>;
+        case YGOR_HALF_PRECISION: return unpack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_HALF_PRECISION>;
+        case YGOR_SINGLE_PRECISION: return unpack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_SINGLE_PRECISION>;
+        case YGOR_DOUBLE_PRECISION: return unpack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_DOUBLE_PRECISION>;
+        default: return NULL;
+    }
+}
+
+unpack_func_t
+series_iterator :: unpack_func(ygor_series* s)
+{
+    switch (s->indep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return unpack_func_precise_integer(s);
+        case YGOR_HALF_PRECISION: return unpack_func_half_precision(s);
+        case YGOR_SINGLE_PRECISION: return unpack_func_single_precision(s);
+        case YGOR_DOUBLE_PRECISION: return unpack_func_double_precision(s);
+        default: return NULL;
+    }
+}
+
+unpack_block_func_t
+series_iterator :: unpack_block_func(ygor_series* s, uint64_t encoding)
+{
+    if (!encoding)
+    {
+        return NULL;
+    }
+
+    if (encoding & YGOR_ENCODING_DELTA_OF_DELTA)
+    {
+        return s->indep_precision == YGOR_PRECISE_INTEGER
+             ? unpack_block_func_indep<dod_codec>(s, encoding) : NULL;
+    }
+
+    switch (s->indep_precision)
+    {
+        case YGOR_PRECISE_INTEGER: return unpack_block_func_indep<delta_codec>(s, encoding);
+        case YGOR_HALF_PRECISION: return unpack_block_func_indep<plain_codec<YGOR_HALF_PRECISION> >(s, encoding);
+        case YGOR_SINGLE_PRECISION: return unpack_block_func_indep<plain_codec<YGOR_SINGLE_PRECISION> >(s, encoding);
+        case YGOR_DOUBLE_PRECISION: return unpack_block_func_indep<plain_codec<YGOR_DOUBLE_PRECISION> >(s, encoding);
+        default: return NULL;
+    }
+}
+
+series_iterator :: series_iterator()
+    : m_reader(NULL)
+    , m_series(NULL)
+    , m_series_idx(0)
+    , m_segment(0)
+    , m_input(NULL)
+    , m_offset(0)
+    , m_map(NULL)
+    , m_map_sz(0)
+    , m_map_pos(0)
+    , m_blocks(NULL)
+    , m_blocks_idx(0)
+    , m_buf()
+    , m_data()
+    , m_data_idx(0)
+    , m_primed(false)
+    , m_error(false)
+    , m_eof(false)
+    , m_unpack()
+    , m_unpack_block()
+    , m_skip_indep(false)
+    , m_precision(0)
+    , m_buckets()
+    , m_weights()
+    , m_sampling(1)
+{
+}
+
+series_iterator :: ~series_iterator() throw ()
+{
+    if (m_input)
+    {
+        fclose(m_input);
+    }
+}
+
+ygor_series*
+series_iterator :: series()
+{
+    return m_series;
+}
+
+int
+series_iterator :: valid()
+{
+    if (m_error)
+    {
+        return -1;
+    }
+
+    if (m_primed)
+    {
+        return 1;
+    }
+
+    if (m_data_idx < m_data.size())
+    {
+        m_primed = true;
+        return 1;
+    }
+
+    while (true)
+    {
+        m_data.clear();
+        m_weights.clear();
+        m_data_idx = 0;
+
+        if (m_blocks)
+        {
+            if (m_blocks_idx >= m_blocks->size())
+            {
+                if (next_segment())
+                {
+                    continue;
+                }
+
+                m_eof = !m_error;
+                return m_eof ? 0 : -1;
+            }
+
+            if (!seek_offset((*m_blocks)[m_blocks_idx].offset))
+            {
+                m_error = true;
+                return -1;
+            }
+
+            ++m_blocks_idx;
+        }
+
+        const unsigned char* hdr = read(sizeof(uint64_t));
+
+        if (!hdr)
+        {
+            if (m_eof && next_segment())
+            {
+                continue;
+            }
+
+            return m_eof && !m_error ? 0 : -1;
+        }
+
+        uint64_t block_sz;
+        e::unpack64be(hdr, &block_sz);
+
+        // the preallocated but unwritten end of a file still being written
+        if (block_sz == 0)
+        {
+            m_eof = true;
+
+            if (next_segment())
+            {
+                continue;
+            }
+
+            return m_error ? -1 : 0;
+        }
+
+        if (block_sz > MAX_BLOCK_BYTES)
+        {
+            m_error = true;
+            return -1;
+        }
+
+        const unsigned char* ptr = read(block_sz);
+
+        if (!ptr)
+        {
+            m_error = true;
+            return -1;
+        }
+
+        const unsigned char* end = ptr + block_sz;
+        uint64_t series;
+        ptr = e::varint64_decode(ptr, end, &series);
+
+        if (!ptr)
+        {
+            m_error = true;
+            return -1;
+        }
+
+        if (series != m_series_idx)
+        {
+            continue;
+        }
+
+        if (!decode(ptr, end))
+        {
+            m_error = true;
+            return -1;
+        }
+
+        if (!m_data.empty())
+        {
+            m_primed = true;
+            return 1;
+        }
+    }
+}
+
+bool
+series_iterator :: decode(const unsigned char* ptr, const unsigned char* end)
+{
+    m_data.clear();
+    m_weights.clear();
+    m_data_idx = 0;
+
+    if (m_precision)
+    {
+        return unpack_snapshot(ptr, end);
+    }
+    else if (m_unpack_block)
+    {
+        return m_unpack_block(ptr, end, m_series, m_skip_indep, &m_data);
+    }
+
+    while (ptr < end)
+    {
+        ygor_data_point* prev = !m_data.empty()
+                              ? &m_data.back() : NULL;
+        ygor_data_point p;
+        const unsigned char* tmp = m_unpack(ptr, end, prev, &p);
+
+        if (!tmp)
+        {
+            return false;
+        }
+
+        p.series = m_series;
+        m_data.push_back(p);
+        ptr = tmp;
+    }
+
+    return true;
+}
+
+void
+series_iterator :: advance()
+{
+    assert(valid() > 0);
+    ++m_data_idx;
+    m_primed = false;
+}
+
+void
+series_iterator :: read(ygor_data_point* ydp)
+{
+    assert(valid() > 0);
+    *ydp = m_data[m_data_idx];
+}
+
+int
+series_iterator :: rewind()
+{
+    m_data.clear();
+    m_weights.clear();
+    m_data_idx = 0;
+    m_blocks_idx = 0;
+    m_primed = false;
+    m_error = false;
+    m_eof = false;
+
+    if (m_segment != 0)
+    {
+        return open_segment(0) ? 0 : -1;
+    }
+
+    return seek_offset(m_offset) ? 0 : -1;
+}
+
+// The index holds each block's last independent value, so the blocks before
+// indep are skipped by their entries alone, and only the block that spans it
+// is decoded.
+int
+series_iterator :: seek(uint64_t indep)
+{
+    if (rewind() < 0)
+    {
+        return -1;
+    }
+
+    index_entry ie;
+
+    while (peek_block(&ie))
+    {
+        ygor_data_value max;
+        memcpy(&max, &ie.max, sizeof(max));
+
+        if (!indep_before(m_series->indep_precision, max, indep))
+        {
             break;
         }
-        else if (ptr + 4 > buffer + used)
+
+        skip_block();
+    }
+
+    return m_error ? -1 : seek_points(this, indep);
+}
+
+void
+series_iterator :: skip_indep(bool skip)
+{
+    m_skip_indep = skip;
+}
+
+bool
+series_iterator :: weighted()
+{
+    return m_precision != 0;
+}
+
+uint64_t
+series_iterator :: weight()
+{
+    assert(valid() > 0);
+    return m_weights.empty() ? m_sampling : m_weights[m_data_idx];
+}
+
+uint64_t
+series_iterator :: cycles_per_second()
+{
+    return m_reader->segments[m_segment]->cycles_per_second[m_series_idx];
+}
+
+int64_t
+series_iterator :: read_batch(ygor_data_point* ydp, uint64_t* weights, size_t max)
+{
+    const int status = valid();
+
+    if (status <= 0)
+    {
+        return status;
+    }
+
+    const size_t n = std::min(max, m_data.size() - m_data_idx);
+    std::copy(m_data.begin() + m_data_idx, m_data.begin() + m_data_idx + n, ydp);
+
+    if (weights && m_weights.empty())
+    {
+        std::fill(weights, weights + n, m_sampling);
+    }
+    else if (weights)
+    {
+        std::copy(m_weights.begin() + m_data_idx, m_weights.begin() + m_data_idx + n, weights);
+    }
+
+    m_data_idx += n;
+    m_primed = false;
+    return n;
+}
+
+int64_t
+series_iterator :: read_columns(uint64_t* indep, double* dep, uint64_t* weights, size_t max)
+{
+    const int status = valid();
+
+    if (status <= 0)
+    {
+        return status;
+    }
+
+    const size_t n = std::min(max, m_data.size() - m_data_idx);
+    const ygor_data_point* data = &m_data[m_data_idx];
+
+    if (indep && ygor_is_precise(m_series->indep_precision))
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            indep[i] = data[i].indep.precise;
+        }
+    }
+    else if (indep)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            indep[i] = data[i].indep.approximate;
+        }
+    }
+
+    if (ygor_is_precise(m_series->dep_precision))
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            dep[i] = data[i].dep.precise;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            dep[i] = data[i].dep.approximate;
+        }
+    }
+
+    if (weights && m_weights.empty())
+    {
+        std::fill(weights, weights + n, m_sampling);
+    }
+    else if (weights)
+    {
+        std::copy(m_weights.begin() + m_data_idx, m_weights.begin() + m_data_idx + n, weights);
+    }
+
+    m_data_idx += n;
+    m_primed = false;
+    return n;
+}
+
+bool
+series_iterator :: peek_block(index_entry* ie)
+{
+    // look past the end of one segment into the next
+    while (m_blocks && !m_error &&
+           m_data_idx >= m_data.size() &&
+           m_blocks_idx >= m_blocks->size() &&
+           next_segment())
+    {
+    }
+
+    if (!m_blocks || m_error ||
+        m_data_idx < m_data.size() ||
+        m_blocks_idx >= m_blocks->size())
+    {
+        return false;
+    }
+
+    *ie = (*m_blocks)[m_blocks_idx];
+    ie->summary.scale(m_sampling);
+    return true;
+}
+
+void
+series_iterator :: skip_block()
+{
+    assert(m_blocks && m_data_idx >= m_data.size());
+    assert(m_blocks_idx < m_blocks->size());
+    ++m_blocks_idx;
+}
+
+bool
+series_iterator :: init(ygor_data_reader* ydr, size_t idx)
+{
+    bind(ydr, idx);
+    return open_segment(0);
+}
+
+void
+series_iterator :: bind(ygor_data_reader* ydr, size_t idx)
+{
+    m_reader = ydr;
+    m_series = &ydr->series[idx];
+    m_series_idx = idx;
+    m_unpack = unpack_func(m_series);
+}
+
+// Position the iterator at the first block of the given segment.  Each
+// segment records its own configuration, which is applied anew.
+bool
+series_iterator :: open_segment(size_t segment)
+{
+    if (!configure(segment))
+    {
+        return false;
+    }
+
+    const data_segment* ds = m_reader->segments[segment];
+    m_data.reserve(std::min(ds->block_sizes[m_series_idx], uint64_t(MAX_SERIES_BUFFER_SIZE)));
+    m_eof = false;
+
+    if (m_map)
+    {
+        return true;
+    }
+
+    m_input = fopen(ds->input.c_str(), "r");
+    return m_input && fseek(m_input, m_offset, SEEK_SET) >= 0;
+}
+
+bool
+series_iterator :: configure(size_t segment)
+{
+    const data_segment* ds = m_reader->segments[segment];
+    const uint64_t encoding = ds->encodings[m_series_idx];
+    m_segment = segment;
+    m_offset = ds->data_offset;
+    m_blocks = ds->indexed ? &ds->blocks[m_series_idx] : NULL;
+    m_blocks_idx = 0;
+    m_unpack_block = NULL;
+    m_precision = 0;
+    m_sampling = std::max(ds->sampling_ratios[m_series_idx], uint64_t(1));
+
+    m_map = ds->mapped;
+    m_map_sz = ds->mapped_sz;
+    m_map_pos = m_offset;
+
+    if (m_input)
+    {
+        fclose(m_input);
+        m_input = NULL;
+    }
+
+    if (encoding == ENCODING_HISTOGRAM)
+    {
+        const uint64_t precision = ds->histogram_precisions[m_series_idx];
+
+        if (precision < 1 || precision > HISTOGRAM_MAX_PRECISION ||
+            m_series->indep_precision != YGOR_PRECISE_INTEGER ||
+            m_series->dep_precision != YGOR_PRECISE_INTEGER)
+        {
+            errno = ENOTSUP;
+            return false;
+        }
+
+        m_precision = precision;
+    }
+    // an encoding from a newer writer that this reader cannot decode
+    else if ((encoding & ~uint64_t(KNOWN_ENCODINGS)) ||
+             (encoding && !(m_unpack_block = unpack_block_func(m_series, encoding))))
+    {
+        errno = ENOTSUP;
+        return false;
+    }
+
+    return true;
+}
+
+// Move on to the segment after this one.  False after the last segment, or
+// if the next could not be opened.
+bool
+series_iterator :: next_segment()
+{
+    if (m_segment + 1 >= m_reader->segments.size())
+    {
+        return false;
+    }
+
+    if (!open_segment(m_segment + 1))
+    {
+        m_error = true;
+        return false;
+    }
+
+    return true;
+}
+
+const unsigned char*
+series_iterator :: read(size_t buf_sz)
+{
+    if (m_error)
+    {
+        return NULL;
+    }
+
+    if (m_map)
+    {
+        if (m_map_pos > m_map_sz || buf_sz > m_map_sz - m_map_pos)
+        {
+            m_eof = true;
+            return NULL;
+        }
+
+        const unsigned char* buf = m_map + m_map_pos;
+        m_map_pos += buf_sz;
+        return buf;
+    }
+
+    m_buf.resize(buf_sz);
+
+    if (fread(&m_buf[0], 1, buf_sz, m_input) != buf_sz)
+    {
+        m_error = ferror(m_input) != 0;
+        m_eof = !m_error && feof(m_input) != 0;
+        return NULL;
+    }
+
+    return &m_buf[0];
+}
+
+bool
+series_iterator :: seek_offset(uint64_t offset)
+{
+    if (m_map)
+    {
+        m_map_pos = offset;
+        return true;
+    }
+
+    return fseek(m_input, offset, SEEK_SET) >= 0;
+}
+
+bool
+series_iterator :: unpack_snapshot(const unsigned char* ptr, const unsigned char* end)
+{
+    uint64_t start = 0;
+    ptr = e::varint64_decode(ptr, end, &start);
+    m_buckets.clear();
+    ptr = ptr ? histogram::unpack(ptr, end, m_precision, &m_buckets, &m_weights) : NULL;
+
+    if (ptr != end)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_buckets.size(); ++i)
+    {
+        ygor_data_point p;
+        p.series = m_series;
+        p.indep.precise = start;
+        p.dep.precise = histogram::bucket_value(m_precision, m_buckets[i]);
+        m_data.push_back(p);
+    }
+
+    return true;
+}
+
+bool
+series_iterator :: find_blocks(std::vector<scan_block>* blocks)
+{
+    while (true)
+    {
+        if (m_blocks)
+        {
+            for (; m_blocks_idx < m_blocks->size(); ++m_blocks_idx)
+            {
+                const index_entry* ie = &(*m_blocks)[m_blocks_idx];
+                blocks->push_back(scan_block(m_segment, ie->offset, ie));
+            }
+        }
+        else
+        {
+            // without an index, blocks are found by their lengths; reading
+            // them through a mapping costs nothing, and through stdio is still
+            // far cheaper than decoding them
+            while (true)
+            {
+                const uint64_t offset = m_map ? m_map_pos : ftello(m_input);
+                const unsigned char* hdr = read(sizeof(uint64_t));
+                uint64_t block_sz = 0;
+
+                if (hdr)
+                {
+                    e::unpack64be(hdr, &block_sz);
+                }
+
+                if (block_sz == 0)
+                {
+                    break;
+                }
+
+                const unsigned char* ptr = block_sz <= MAX_BLOCK_BYTES ? read(block_sz) : NULL;
+                uint64_t series;
+
+                if (!ptr || !e::varint64_decode(ptr, ptr + block_sz, &series))
+                {
+                    m_error = true;
+                    return false;
+                }
+
+                if (series == m_series_idx)
+                {
+                    blocks->push_back(scan_block(m_segment, offset, NULL));
+                }
+            }
+
+            if (m_error)
+            {
+                return false;
+            }
+        }
+
+        if (!next_segment())
+        {
+            m_eof = !m_error;
+            return !m_error;
+        }
+    }
+}
+
+bool
+series_iterator :: scan_one(const scan_block& sb, block_scan* bs, std::vector<uint64_t>* weights)
+{
+    if ((!m_map && !m_input) || m_segment != sb.segment)
+    {
+        if (!open_segment(sb.segment))
+        {
+            return false;
+        }
+    }
+
+    if (sb.entry)
+    {
+        index_entry ie(*sb.entry);
+        ie.summary.scale(m_sampling);
+
+        if (bs->entry(ie))
+        {
+            return true;
+        }
+    }
+
+    const unsigned char* hdr = NULL;
+    uint64_t block_sz = 0;
+
+    if (!seek_offset(sb.offset) || !(hdr = read(sizeof(uint64_t))))
+    {
+        return false;
+    }
+
+    e::unpack64be(hdr, &block_sz);
+    const unsigned char* ptr = block_sz <= MAX_BLOCK_BYTES ? read(block_sz) : NULL;
+
+    if (!ptr)
+    {
+        return false;
+    }
+
+    const unsigned char* end = ptr + block_sz;
+    uint64_t series;
+    ptr = e::varint64_decode(ptr, end, &series);
+
+    if (!ptr || series != m_series_idx || !decode(ptr, end))
+    {
+        return false;
+    }
+
+    if (m_data.empty())
+    {
+        return true;
+    }
+
+    if (m_weights.empty())
+    {
+        weights->assign(m_data.size(), m_sampling);
+    }
+
+    bs->points(&m_data[0], m_weights.empty() ? &(*weights)[0] : &m_weights[0], m_data.size());
+    return true;
+}
+
+// One thread of a parallel scan.  The blocks are dealt out in contiguous
+// runs, one per worker; a worker takes blocks from the front of its own run,
+// and once it runs dry, steals the back half of another's.
+struct scan_worker
+{
+    scan_worker(size_t next, size_t end);
+    ~scan_worker() throw ();
+
+    bool take(size_t* idx);
+    bool steal(scan_worker* victim, size_t* idx);
+
+    po6::threads::mutex mtx;
+    size_t next;
+    size_t end;
+    series_iterator it;
+    block_scan* partial;
+    bool failed;
+
+    private:
+        scan_worker(const scan_worker&);
+        scan_worker& operator = (const scan_worker&);
+};
+
+scan_worker :: scan_worker(size_t n, size_t e)
+    : mtx()
+    , next(n)
+    , end(e)
+    , it()
+    , partial(NULL)
+    , failed(false)
+{
+}
+
+scan_worker :: ~scan_worker() throw ()
+{
+    delete partial;
+}
+
+bool
+scan_worker :: take(size_t* idx)
+{
+    po6::threads::mutex::hold hold(&mtx);
+
+    if (next >= end)
+    {
+        return false;
+    }
+
+    *idx = next;
+    ++next;
+    return true;
+}
+
+bool
+scan_worker :: steal(scan_worker* victim, size_t* idx)
+{
+    size_t stolen_next;
+    size_t stolen_end;
+
+    {
+        po6::threads::mutex::hold hold(&victim->mtx);
+
+        if (victim->next >= victim->end)
         {
             return false;
         }
-        else
+
+        stolen_end = victim->end;
+        stolen_next = victim->next + (victim->end - victim->next) / 2;
+        victim->end = stolen_next;
+    }
+
+    po6::threads::mutex::hold hold(&mtx);
+    *idx = stolen_next;
+    next = stolen_next + 1;
+    end = stolen_end;
+    return true;
+}
+
+static void
+scan_worker_run(std::vector<scan_worker*>* workers, size_t self,
+                const std::vector<scan_block>* blocks)
+{
+    scan_worker* w = (*workers)[self];
+    std::vector<uint64_t> weights;
+    size_t idx = 0;
+
+    while (!w->failed)
+    {
+        bool found = w->take(&idx);
+
+        for (size_t i = 1; !found && i < workers->size(); ++i)
         {
-            names.push_back(buffer);
-            series.push_back(ygor_series());
-            series.back().name = names.back().c_str();
-            series.back().indep_units = (ygor_units)ptr[1];
-            series.back().indep_precision = (ygor_precision)ptr[2];
-            series.back().dep_units = (ygor_units)ptr[3];
-            series.back().dep_precision = (ygor_precision)ptr[4];
+            found = w->steal((*workers)[(self + i) % workers->size()], &idx);
+        }
 
-            char* tmp = ptr + 5;
-            size_t rem = tmp - buffer;
-            memmove(buffer, tmp, used - rem);
-            used -= rem;
+        if (!found)
+        {
+            break;
         }
+
+        w->failed = !w->it.scan_one((*blocks)[idx], w->partial, &weights);
     }
+}
 
-    return true;
+// Find the blocks left to read, and decode and feed them from as many threads
+// as the reader allows, each with its own iterator over the series.
+int
+series_iterator :: scan(block_scan* bs)
+{
+    if (m_reader->scan_threads <= 1)
+    {
+        return ygor_data_iterator::scan(bs);
+    }
+
+    // the block already begun
+    std::vector<ygor_data_point> points(READ_BATCH_SIZE);
+    std::vector<uint64_t> weights(READ_BATCH_SIZE);
+
+    while (!m_error && m_data_idx < m_data.size())
+    {
+        const int64_t n = read_batch(&points[0], &weights[0], READ_BATCH_SIZE);
+        assert(n > 0);
+        bs->points(&points[0], &weights[0], n);
+    }
+
+    std::vector<scan_block> blocks;
+
+    if (m_error || !find_blocks(&blocks))
+    {
+        return -1;
+    }
+
+    m_data.clear();
+    m_weights.clear();
+    m_data_idx = 0;
+    m_primed = false;
+    const size_t threads_sz = std::min(blocks.size(), size_t(m_reader->scan_threads));
+    std::vector<scan_worker*> workers;
+
+    for (size_t i = 0; i < threads_sz; ++i)
+    {
+        workers.push_back(new scan_worker(blocks.size() * i / threads_sz,
+                                          blocks.size() * (i + 1) / threads_sz));
+        workers.back()->it.bind(m_reader, m_series_idx);
+        workers.back()->it.m_skip_indep = m_skip_indep;
+        workers.back()->partial = bs->partial();
+    }
+
+    // this thread is the first worker
+    std::vector<po6::threads::thread*> threads;
+
+    for (size_t i = 1; i < threads_sz; ++i)
+    {
+        threads.push_back(new po6::threads::thread(po6::threads::make_func(&scan_worker_run, &workers, i, &blocks)));
+        threads.back()->start();
+    }
+
+    if (threads_sz > 0)
+    {
+        scan_worker_run(&workers, 0, &blocks);
+    }
+
+    bool failed = false;
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        failed = failed || workers[i]->failed;
+        bs->merge(workers[i]->partial);
+        delete workers[i];
+    }
+
+    return failed ? -1 : 0;
 }
 
-struct ygor_data_iterator
+YGOR_API int
+ygor_data_iterator_sample(ygor_data_iterator* ydi,
+                          ygor_data_point* ydp, size_t ydp_sz,
+                          size_t* k, size_t* n)
 {
-    ygor_data_iterator();
-    virtual ~ygor_data_iterator() throw ();
+    if (ydp_sz <= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
 
-    virtual ygor_series* series() = 0;
-    virtual int valid() = 0;
-    virtual void advance() = 0;
-    virtual void read(ygor_data_point* ydp) = 0;
-    virtual int rewind() = 0;
+    guacamole g;
+    guacamole_seed(&g, (intptr_t)ydi);
+    size_t elem = 0;
+    std::vector<ygor_data_point> points(READ_BATCH_SIZE);
+    int64_t batch = 0;
+
+    while ((batch = ydi->read_batch(&points[0], NULL, READ_BATCH_SIZE)) > 0)
+    {
+        for (int64_t i = 0; i < batch; ++i)
+        {
+            if (elem < ydp_sz)
+            {
+                ydp[elem] = points[i];
+            }
+            else
+            {
+                size_t idx = guacamole_double(&g) * elem;
+
+                if (idx < ydp_sz)
+                {
+                    ydp[idx] = points[i];
+                }
+            }
+
+            ++elem;
+        }
+    }
+
+    if (batch < 0)
+    {
+        return -1;
+    }
+
+    *n = elem;
+    *k = std::min(ydp_sz, *n);
+    return 0;
+}
+
+struct convert
+{
+    ygor_units from;
+    ygor_units to;
+    double rate;
 };
 
-ygor_data_iterator :: ygor_data_iterator()
+static const convert conversion_rates[] = {{YGOR_UNIT_S, YGOR_UNIT_MS, 1000},
+                                           {YGOR_UNIT_S, YGOR_UNIT_US, 1000000},
+                                           {YGOR_UNIT_MS, YGOR_UNIT_US, 1000},
+                                           {YGOR_UNIT_US, YGOR_UNIT_S, 0.000001},
+                                           {YGOR_UNIT_US, YGOR_UNIT_MS, 0.001},
+                                           {YGOR_UNIT_MS, YGOR_UNIT_S, 0.001},
+                                           {YGOR_UNIT_S, YGOR_UNIT_NS, 1000000000},
+                                           {YGOR_UNIT_MS, YGOR_UNIT_NS, 1000000},
+                                           {YGOR_UNIT_US, YGOR_UNIT_NS, 1000},
+                                           {YGOR_UNIT_NS, YGOR_UNIT_US, 0.001},
+                                           {YGOR_UNIT_NS, YGOR_UNIT_MS, 0.000001},
+                                           {YGOR_UNIT_NS, YGOR_UNIT_S, 0.000000001},
+                                           {YGOR_UNIT_BYTES, YGOR_UNIT_KBYTES, 0.001},
+                                           {YGOR_UNIT_BYTES, YGOR_UNIT_MBYTES, 0.000001},
+                                           {YGOR_UNIT_BYTES, YGOR_UNIT_GBYTES, 0.000000001},
+                                           {YGOR_UNIT_KBYTES, YGOR_UNIT_MBYTES, 0.001},
+                                           {YGOR_UNIT_KBYTES, YGOR_UNIT_GBYTES, 0.000001},
+                                           {YGOR_UNIT_MBYTES, YGOR_UNIT_GBYTES, 0.001},
+                                           {YGOR_UNIT_GBYTES, YGOR_UNIT_MBYTES, 1000},
+                                           {YGOR_UNIT_GBYTES, YGOR_UNIT_KBYTES, 1000000},
+                                           {YGOR_UNIT_GBYTES, YGOR_UNIT_BYTES, 1000000000},
+                                           {YGOR_UNIT_MBYTES, YGOR_UNIT_KBYTES, 1000},
+                                           {YGOR_UNIT_MBYTES, YGOR_UNIT_BYTES, 1000000},
+                                           {YGOR_UNIT_KBYTES, YGOR_UNIT_BYTES, 1000},
+                                           {(ygor_units)0, (ygor_units)0, 0}};
+
+YGOR_API int
+ygor_units_compatible(ygor_units from, ygor_units to)
 {
+    const convert* c = conversion_rates;
+
+    while (c->from && c->to)
+    {
+        if (c->from == from && c->to == to)
+        {
+            return true;
+        }
+
+        ++c;
+    }
+
+    return from == to;
 }
 
-ygor_data_iterator :: ~ygor_data_iterator() throw ()
+YGOR_API double
+ygor_units_conversion_ratio(ygor_units from, ygor_units to)
 {
+    assert(ygor_units_compatible(from, to));
+    const convert* c = conversion_rates;
+
+    while (c->from && c->to)
+    {
+        if (c->from == from && c->to == to)
+        {
+            return c->rate;
+        }
+
+        ++c;
+    }
+
+    assert(from == to);
+    return 1.0;
 }
 
-struct series_iterator : public ygor_data_iterator
+struct conversion_iterator : public ygor_data_iterator
 {
-    static unpack_func_t unpack_func(ygor_series* s);
-
-    series_iterator();
-    virtual ~series_iterator() throw ();
+    conversion_iterator();
+    virtual ~conversion_iterator() throw ();
 
     virtual ygor_series* series();
     virtual int valid();
     virtual void advance();
     virtual void read(ygor_data_point* ydp);
     virtual int rewind();
+    virtual int seek(uint64_t indep);
+    virtual void skip_indep(bool skip);
+    virtual bool weighted();
+    virtual uint64_t weight();
+    virtual uint64_t cycles_per_second();
+    virtual int64_t read_batch(ygor_data_point* ydp, uint64_t* weights, size_t max);
+    virtual int64_t read_columns(uint64_t* indep, double* dep, uint64_t* weights, size_t max);
+    virtual bool peek_block(index_entry* ie);
+    virtual void skip_block();
+    virtual int scan(block_scan* bs);
+
+    void convert_entry(index_entry* ie);
 
-    bool init(ygor_series* s, size_t idx, const char* input, off_t offset);
-    bool read(unsigned char* buf, size_t buf_sz);
-
-    ygor_series* m_series;
-    size_t m_series_idx;
-    FILE* m_input;
-    off_t m_offset;
-
-    std::vector<ygor_data_point> m_data;
-    size_t m_data_idx;
-    bool m_primed;
-    bool m_error;
-    bool m_eof;
-    unpack_func_t m_unpack;
+    ygor_data_iterator* m_it;
+    ygor_series m_series;
+    double m_indep_scale;
+    double m_dep_scale;
+    std::vector<ygor_data_point> m_points;
 
     private:
-        series_iterator(const series_iterator&);
-        series_iterator& operator = (const series_iterator&);
+        conversion_iterator(const conversion_iterator&);
+        conversion_iterator& operator = (const conversion_iterator&);
 };
 
-YGOR_API ygor_data_iterator*
-ygor_data_iterate(ygor_data_reader* ydr, const char* name)
+// Cycles convert to any unit of time at the rate the file records for them
+static bool
+conversion_ratio(ygor_data_iterator* ydi, ygor_units from, ygor_units to, double* ratio)
+{
+    if (from == YGOR_UNIT_CYCLES && to != YGOR_UNIT_CYCLES)
+    {
+        const uint64_t rate = ydi->cycles_per_second();
+
+        if (rate == 0 || !ygor_units_compatible(YGOR_UNIT_S, to))
+        {
+            return false;
+        }
+
+        *ratio = ygor_units_conversion_ratio(YGOR_UNIT_S, to) / rate;
+        return true;
+    }
+
+    if (!ygor_units_compatible(from, to))
+    {
+        return false;
+    }
+
+    *ratio = ygor_units_conversion_ratio(from, to);
+    return true;
+}
+
+YGOR_API struct ygor_data_iterator*
+ygor_data_convert_units(ygor_data_iterator* ydi,
+                        ygor_units new_indep_units,
+                        ygor_units new_dep_units)
 {
-    size_t idx = 0;
+    double indep_scale = 1.0;
+    double dep_scale = 1.0;
 
-    for (idx = 0; idx < ydr->series.size(); ++idx)
+    if (!conversion_ratio(ydi, ydi->series()->indep_units, new_indep_units, &indep_scale) ||
+        !conversion_ratio(ydi, ydi->series()->dep_units, new_dep_units, &dep_scale))
     {
-        if (strcmp(ydr->series[idx].name, name) == 0)
-        {
-            break;
-        }
+        return NULL;
     }
 
-    if (idx == ydr->series.size())
+    conversion_iterator* ci = new conversion_iterator();
+    ci->m_it = ydi;
+    ci->m_series = *ydi->series();
+
+    if (ydi->series()->indep_units != new_indep_units)
     {
-        errno = ENOENT;
-        return NULL;
+        ci->m_series.indep_precision = approximate_precision(ci->m_series.indep_precision);
     }
 
-    series_iterator* ydi = new series_iterator();
+    ci->m_series.indep_units = new_indep_units;
 
-    if (!ydi->init(&ydr->series[idx], idx, ydr->input.c_str(), ydr->data_offset))
+    if (ydi->series()->dep_units != new_dep_units)
     {
-        delete ydi;
-        return NULL;
+        ci->m_series.dep_precision = approximate_precision(ci->m_series.dep_precision);
     }
 
-    return ydi;
+    ci->m_series.dep_units = new_dep_units;
+    ci->m_indep_scale = indep_scale;
+    ci->m_dep_scale = dep_scale;
+    return ci;
 }
 
-YGOR_API void
-ygor_data_iterator_destroy(ygor_data_iterator* ydi)
+conversion_iterator :: conversion_iterator()
+    : m_it(NULL)
+    , m_series()
+    , m_indep_scale(1.0)
+    , m_dep_scale(1.0)
+    , m_points()
 {
-    delete ydi;
 }
 
-YGOR_API const struct ygor_series*
-ygor_data_iterator_series(ygor_data_iterator* ydi)
+conversion_iterator :: ~conversion_iterator() throw ()
 {
-    return ydi->series();
+    delete m_it;
 }
 
-YGOR_API int
-ygor_data_iterator_valid(ygor_data_iterator* ydi)
+ygor_series*
+conversion_iterator :: series()
 {
-    return ydi->valid();
+    return &m_series;
 }
 
-YGOR_API void
-ygor_data_iterator_advance(ygor_data_iterator* ydi)
+int
+conversion_iterator :: valid()
 {
-    return ydi->advance();
+    return m_it->valid();
 }
 
-YGOR_API int
-ygor_data_iterator_rewind(ygor_data_iterator* ydi)
+void
+conversion_iterator :: advance()
 {
-    return ydi->rewind();
+    return m_it->advance();
 }
 
-YGOR_API void
-ygor_data_iterator_read(ygor_data_iterator* ydi, ygor_data_point* ydp)
+static void
+convert_value(ygor_precision from, ygor_precision to, double scale, ygor_data_value* v)
 {
-    return ydi->read(ydp);
+    if (ygor_is_precise(to))
+    {
+        assert(scale < 1.0001 && scale > 0.9999);
+    }
+    else if (ygor_is_precise(from))
+    {
+        v->approximate = v->precise * scale;
+    }
+    else
+    {
+        v->approximate *= scale;
+    }
 }
 
-template <ygor_precision P>
-const unsigned char* unpack_value_templ(const unsigned char* in, const unsigned char* end, ygor_data_value* v);
+void
+conversion_iterator :: read(ygor_data_point* ydp)
+{
+    m_it->read(ydp);
+    convert_value(ydp->series->indep_precision, m_series.indep_precision, m_indep_scale, &ydp->indep);
+    convert_value(ydp->series->dep_precision, m_series.dep_precision, m_dep_scale, &ydp->dep);
+    ydp->series = &m_series;
+}
 
-template <>
-const unsigned char*
-unpack_value_templ<YGOR_PRECISE_INTEGER>(const unsigned char* in, const unsigned char* end, ygor_data_value* v)
+int
+conversion_iterator :: rewind()
 {
-    if (!in) return NULL;
-    return e::varint64_decode(in, end, &v->precise);
+    return m_it->rewind();
 }
 
-template <>
-const unsigned char*
-unpack_value_templ<YGOR_HALF_PRECISION>(const unsigned char* in, const unsigned char* end, ygor_data_value* v)
+// Seek the underlying iterator to indep in its own units, rounded down, and
+// then past the points that still fall short once converted.
+int
+conversion_iterator :: seek(uint64_t indep)
 {
-    if (!in) return NULL;
-    if (end - in < 2) return NULL;
-    uint16_t h;
-    in = e::unpack16be(in, &h);
-    v->approximate = halffloat_decompress(h);
-    return in;
+    uint64_t inner = indep;
+
+    if (m_series.indep_units != m_it->series()->indep_units)
+    {
+        const double scaled = indep / m_indep_scale;
+        inner = scaled < double(UINT64_MAX) ? uint64_t(scaled) : UINT64_MAX;
+    }
+
+    if (m_it->seek(inner) < 0)
+    {
+        return -1;
+    }
+
+    return seek_points(this, indep);
 }
 
-template <>
-const unsigned char*
-unpack_value_templ<YGOR_SINGLE_PRECISION>(const unsigned char* in, const unsigned char* end, ygor_data_value* v)
+void
+conversion_iterator :: skip_indep(bool skip)
 {
-    if (!in) return NULL;
-    if (end - in < 4) return NULL;
-    float x;
-    in = e::unpackfloatbe(in, &x);
-    v->approximate = x;
-    return in;
+    m_it->skip_indep(skip);
 }
 
-template <>
-const unsigned char*
-unpack_value_templ<YGOR_DOUBLE_PRECISION>(const unsigned char* in, const unsigned char* end, ygor_data_value* v)
+bool
+conversion_iterator :: weighted()
 {
-    if (!in) return NULL;
-    if (end - in < 8) return NULL;
-    return e::unpackdoublebe(in, &v->approximate);
+    return m_it->weighted();
 }
 
-template <ygor_precision I, ygor_precision D>
-const unsigned char*
-unpack_func_templ(const unsigned char* in, const unsigned char* end, const ygor_data_point*, ygor_data_point* point)
+uint64_t
+conversion_iterator :: weight()
 {
-    in = unpack_value_templ<I>(in, end, &point->indep);
-    return unpack_value_templ<D>(in, end, &point->dep);
+    return m_it->weight();
 }
 
-const unsigned char*
-unpack_func_ipi(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+int64_t
+conversion_iterator :: read_batch(ygor_data_point* ydp, uint64_t* weights, size_t max)
 {
-    if (!in) return NULL;
-    in = e::varint64_decode(in, end, &point->indep.precise);
+    const int64_t n = m_it->read_batch(ydp, weights, max);
+    const ygor_series* s = m_it->series();
 
-    if (prev)
+    for (int64_t i = 0; i < n; ++i)
     {
-        point->indep.precise += prev->indep.precise;
+        convert_value(s->indep_precision, m_series.indep_precision, m_indep_scale, &ydp[i].indep);
+        convert_value(s->dep_precision, m_series.dep_precision, m_dep_scale, &ydp[i].dep);
+        ydp[i].series = &m_series;
     }
 
-    return in;
+    return n;
 }
 
-const unsigned char*
-unpack_func_pi_pi(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+int64_t
+conversion_iterator :: read_columns(uint64_t* indep, double* dep, uint64_t* weights, size_t max)
 {
-    in = unpack_func_ipi(in, end, prev, point);
-    return unpack_value_templ<YGOR_PRECISE_INTEGER>(in, end, &point->dep);
+    // the underlying columns hold independent values already rounded down, so
+    // read whole points to scale them first, as read and read_batch do
+    if (indep && m_series.indep_units != m_it->series()->indep_units)
+    {
+        m_points.resize(std::max(max, size_t(1)));
+        const int64_t n = read_batch(&m_points[0], weights, max);
+
+        for (int64_t i = 0; i < n; ++i)
+        {
+            indep[i] = ygor_is_precise(m_series.indep_precision) ? m_points[i].indep.precise : uint64_t(m_points[i].indep.approximate);
+            dep[i] = value_to_double(m_series.dep_precision, m_points[i].dep);
+        }
+
+        return n;
+    }
+
+    const int64_t n = m_it->read_columns(indep, dep, weights, max);
+
+    if (m_series.dep_units != m_it->series()->dep_units)
+    {
+        for (int64_t i = 0; i < n; ++i)
+        {
+            dep[i] *= m_dep_scale;
+        }
+    }
+
+    return n;
 }
 
-const unsigned char*
-unpack_func_pi_hp(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+uint64_t
+conversion_iterator :: cycles_per_second()
 {
-    in = unpack_func_ipi(in, end, prev, point);
-    return unpack_value_templ<YGOR_HALF_PRECISION>(in, end, &point->dep);
+    return m_series.indep_units == YGOR_UNIT_CYCLES ||
+           m_series.dep_units == YGOR_UNIT_CYCLES ? m_it->cycles_per_second() : 0;
 }
 
-const unsigned char*
-unpack_func_pi_sp(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+bool
+conversion_iterator :: peek_block(index_entry* ie)
 {
-    in = unpack_func_ipi(in, end, prev, point);
-    return unpack_value_templ<YGOR_SINGLE_PRECISION>(in, end, &point->dep);
+    if (!m_it->peek_block(ie))
+    {
+        return false;
+    }
+
+    convert_entry(ie);
+    return true;
 }
 
-const unsigned char*
-unpack_func_pi_dp(const unsigned char* in, const unsigned char* end, const ygor_data_point* prev, ygor_data_point* point)
+void
+conversion_iterator :: skip_block()
 {
-    in = unpack_func_ipi(in, end, prev, point);
-    return unpack_value_templ<YGOR_DOUBLE_PRECISION>(in, end, &point->dep);
+    m_it->skip_block();
 }
 
-unpack_func_t
-unpack_func_precise_integer(ygor_series* s)
+// Feeds a scan what the underlying iterator feeds it, converted
+struct conversion_scan : public block_scan
+{
+    conversion_scan(conversion_iterator* ci, block_scan* bs, bool owned);
+    virtual ~conversion_scan() throw ();
+
+    virtual block_scan* partial();
+    virtual bool entry(const index_entry& ie);
+    virtual void points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz);
+    virtual void merge(block_scan* other);
+
+    conversion_iterator* m_ci;
+    block_scan* m_bs;
+    bool m_owned;
+    std::vector<ygor_data_point> m_points;
+
+    private:
+        conversion_scan(const conversion_scan&);
+        conversion_scan& operator = (const conversion_scan&);
+};
+
+conversion_scan :: conversion_scan(conversion_iterator* ci, block_scan* bs, bool owned)
+    : m_ci(ci)
+    , m_bs(bs)
+    , m_owned(owned)
+    , m_points()
 {
-    switch (s->dep_precision)
-    {
-        case YGOR_PRECISE_INTEGER: return unpack_func_pi_pi;
-        case YGOR_HALF_PRECISION: return unpack_func_pi_hp;
-        case YGOR_SINGLE_PRECISION: return unpack_func_pi_sp;
-        case YGOR_DOUBLE_PRECISION: return unpack_func_pi_dp;
-        default: return NULL;
-    }
 }
 
-unpack_func_t
-unpack_func_half_precision(ygor_series* s)
+conversion_scan :: ~conversion_scan() throw ()
 {
-    switch (s->dep_precision)
+    if (m_owned)
     {
-        case YGOR_PRECISE_INTEGER: return unpack_func_templ<YGOR_HALF_PRECISION, YGOR_PRECISE_INTEGER>;
-        case YGOR_HALF_PRECISION: return unpack_func_templ<YGOR_HALF_PRECISION, YGOR_HALF_PRECISION>;
-        case YGOR_SINGLE_PRECISION: return unpack_func_templ<YGOR_HALF_PRECISION, YGOR_SINGLE_PRECISION>;
-        case YGOR_DOUBLE_PRECISION: return unpack_func_templ<YGOR_HALF_PRECISION, YGOR_DOUBLE_PRECISION>;
-        default: return NULL;
+        delete m_bs;
     }
 }
 
-unpack_func_t
-unpack_func_single_precision(ygor_series* s)
+block_scan*
+conversion_scan :: partial()
 {
-    switch (s->dep_precision)
-    {
-        case YGOR_PRECISE_INTEGER: return unpack_func_templ<YGOR_SINGLE_PRECISION, YGOR_PRECISE_INTEGER>;
-        case YGOR_HALF_PRECISION: return unpack_func_templ<YGOR_SINGLE_PRECISION, YGOR_HALF_PRECISION>;
-        case YGOR_SINGLE_PRECISION: return unpack_func_templ<YGOR_SINGLE_PRECISION, YGOR_SINGLE_PRECISION>;
-        case YGOR_DOUBLE_PRECISION: return unpack_func_templ<YGOR_SINGLE_PRECISION, YGOR_DOUBLE_PRECISION>;
-        default: return NULL;
-    }
+    return new conversion_scan(m_ci, m_bs->partial(), true);
 }
 
-unpack_func_t
-unpack_func_double_precision(ygor_series* s)
+bool
+conversion_scan :: entry(const index_entry& ie)
 {
-    switch (s->dep_precision)
-    {
-        case YGOR_PRECISE_INTEGER: return unpack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_PRECISE_INTEGER>;
-        case YGOR_HALF_PRECISION: return unpack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_HALF_PRECISION>;
-        case YGOR_SINGLE_PRECISION: return unpack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_SINGLE_PRECISION>;
-        case YGOR_DOUBLE_PRECISION: return unpack_func_templ<YGOR_DOUBLE_PRECISION, YGOR_DOUBLE_PRECISION>;
-        default: return NULL;
-    }
+    index_entry converted(ie);
+    m_ci->convert_entry(&converted);
+    return m_bs->entry(converted);
 }
 
-unpack_func_t
-series_iterator :: unpack_func(ygor_series* s)
+void
+conversion_scan :: points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz)
 {
-    switch (s->indep_precision)
+    const ygor_series* s = m_ci->m_it->series();
+    const ygor_series* t = &m_ci->m_series;
+    m_points.assign(ydp, ydp + ydp_sz);
+
+    for (size_t i = 0; i < ydp_sz; ++i)
     {
-        case YGOR_PRECISE_INTEGER: return unpack_func_precise_integer(s);
-        case YGOR_HALF_PRECISION: return unpack_func_half_precision(s);
-        case YGOR_SINGLE_PRECISION: return unpack_func_single_precision(s);
-        case YGOR_DOUBLE_PRECISION: return unpack_func_double_precision(s);
-        default: return NULL;
+        convert_value(s->indep_precision, t->indep_precision, m_ci->m_indep_scale, &m_points[i].indep);
+        convert_value(s->dep_precision, t->dep_precision, m_ci->m_dep_scale, &m_points[i].dep);
+        m_points[i].series = t;
     }
+
+    m_bs->points(&m_points[0], weights, ydp_sz);
+}
+
+void
+conversion_scan :: merge(block_scan* other)
+{
+    m_bs->merge(static_cast<conversion_scan*>(other)->m_bs);
+}
+
+int
+conversion_iterator :: scan(block_scan* bs)
+{
+    conversion_scan cs(this, bs, false);
+    return m_it->scan(&cs);
+}
+
+void
+conversion_iterator :: convert_entry(index_entry* ie)
+{
+    const ygor_precision from = m_it->series()->indep_precision;
+    ygor_data_value v;
+    memcpy(&v, &ie->min, sizeof(v));
+    convert_value(from, m_series.indep_precision, m_indep_scale, &v);
+    memcpy(&ie->min, &v, sizeof(v));
+    memcpy(&v, &ie->max, sizeof(v));
+    convert_value(from, m_series.indep_precision, m_indep_scale, &v);
+    memcpy(&ie->max, &v, sizeof(v));
+    block_summary* bs = &ie->summary;
+    bs->indep_sum *= m_indep_scale;
+    bs->indep_sumsq *= m_indep_scale * m_indep_scale;
+    bs->dep_min *= m_dep_scale;
+    bs->dep_max *= m_dep_scale;
+    bs->dep_sum *= m_dep_scale;
+    bs->dep_sumsq *= m_dep_scale * m_dep_scale;
+}
+
+// Passes through only the points with independent values in [start, end).
+// Blocks that the index places wholly outside the window are skipped unread,
+// and those wholly inside are offered to peek_block as they are.
+struct window_iterator : public ygor_data_iterator
+{
+    window_iterator(ygor_data_iterator* ydi, uint64_t start, uint64_t end);
+    virtual ~window_iterator() throw ();
+
+    virtual ygor_series* series();
+    virtual int valid();
+    virtual void advance();
+    virtual void read(ygor_data_point* ydp);
+    virtual int rewind();
+    virtual int seek(uint64_t indep);
+    // the window needs independent values, so skip_indep goes no further
+    virtual bool weighted();
+    virtual uint64_t weight();
+    virtual uint64_t cycles_per_second();
+    virtual int64_t read_batch(ygor_data_point* ydp, uint64_t* weights, size_t max);
+    virtual int64_t read_columns(uint64_t* indep, double* dep, uint64_t* weights, size_t max);
+    virtual bool peek_block(index_entry* ie);
+    virtual void skip_block();
+    virtual int scan(block_scan* bs);
+
+    // seek to the start of the window unless already positioned
+    int position();
+    bool contains(const ygor_data_value& indep);
+    // whether a block lies wholly outside the window, or wholly inside it
+    bool excludes(const index_entry& ie);
+    bool includes(const index_entry& ie);
+
+    ygor_data_iterator* m_it;
+    uint64_t m_start;
+    uint64_t m_end;
+    bool m_positioned;
+    std::vector<ygor_data_point> m_points;
+
+    private:
+        window_iterator(const window_iterator&);
+        window_iterator& operator = (const window_iterator&);
+};
+
+YGOR_API struct ygor_data_iterator*
+ygor_data_window(ygor_data_iterator* ydi, uint64_t start, uint64_t end)
+{
+    return new window_iterator(ydi, start, end);
 }
 
-series_iterator :: series_iterator()
-    : m_series(NULL)
-    , m_series_idx(0)
-    , m_input(NULL)
-    , m_offset(0)
-    , m_data()
-    , m_data_idx(0)
-    , m_primed(false)
-    , m_error(false)
-    , m_eof(false)
-    , m_unpack()
+window_iterator :: window_iterator(ygor_data_iterator* ydi, uint64_t start, uint64_t end)
+    : m_it(ydi)
+    , m_start(start)
+    , m_end(end)
+    , m_positioned(false)
+    , m_points()
 {
 }
 
-series_iterator :: ~series_iterator() throw ()
+window_iterator :: ~window_iterator() throw ()
 {
-    if (m_input)
-    {
-        fclose(m_input);
-    }
+    delete m_it;
 }
 
 ygor_series*
-series_iterator :: series()
+window_iterator :: series()
 {
-    return m_series;
+    return m_it->series();
 }
 
 int
-series_iterator :: valid()
+window_iterator :: valid()
 {
-    if (m_error)
+    if (position() < 0)
     {
         return -1;
     }
 
-    if (m_primed)
-    {
-        return 1;
-    }
-
-    if (m_data_idx < m_data.size())
-    {
-        m_primed = true;
-        return 1;
-    }
-
     while (true)
     {
-        m_data.clear();
-        m_data_idx = 0;
-        unsigned char buf[VARINT_64_MAX_SIZE + SERIES_BUFFER_SIZE * MAX_POINT_SIZE];
-
-        if (!read(buf, sizeof(uint64_t)))
-        {
-            return m_eof ? 0 : -1;
-        }
-
-        uint64_t block_sz;
-        e::unpack64be(buf, &block_sz);
-
-        if (!read(buf, block_sz))
-        {
-            m_error = true;
-            return -1;
-        }
-
-        const unsigned char* ptr = buf;
-        const unsigned char* end = ptr + block_sz;
-        uint64_t series;
-        ptr = e::varint64_decode(ptr, end, &series);
+        index_entry ie;
 
-        if (!ptr)
+        // a block wholly in the window needs no checking point by point
+        if (peek_block(&ie))
         {
-            m_error = true;
-            return -1;
+            return m_it->valid();
         }
 
-        if (series != m_series_idx)
-        {
-            continue;
-        }
+        const int status = m_it->valid();
 
-        while (ptr < end)
+        if (status <= 0)
         {
-            ygor_data_point* prev = !m_data.empty()
-                                  ? &m_data.back() : NULL;
-            ygor_data_point p;
-            const unsigned char* tmp = m_unpack(ptr, end, prev, &p);
-
-            if (!tmp)
-            {
-                m_error = true;
-                return -1;
-            }
-
-            p.series = m_series;
-            m_data.push_back(p);
-            ptr = tmp;
+            return status;
         }
 
-        assert(ptr == end);
+        ygor_data_point ydp;
+        m_it->read(&ydp);
 
-        if (!m_data.empty())
+        if (contains(ydp.indep))
         {
-            m_primed = true;
             return 1;
         }
+
+        m_it->advance();
     }
 }
 
 void
-series_iterator :: advance()
+window_iterator :: advance()
 {
-    assert(valid() > 0);
-    ++m_data_idx;
-    m_primed = false;
+    m_it->advance();
 }
 
 void
-series_iterator :: read(ygor_data_point* ydp)
+window_iterator :: read(ygor_data_point* ydp)
 {
-    assert(valid() > 0);
-    *ydp = m_data[m_data_idx];
+    m_it->read(ydp);
 }
 
 int
-series_iterator :: rewind()
+window_iterator :: rewind()
 {
-    m_data.clear();
-    m_data_idx = 0;
-    m_primed = false;
-    m_error = false;
-    m_eof = false;
-    return fseek(m_input, m_offset, SEEK_SET) >= 0 ? 0 : -1;
+    m_positioned = false;
+    return m_it->rewind();
 }
 
-bool
-series_iterator :: init(ygor_series* s, size_t idx, const char* name, off_t offset)
+int
+window_iterator :: seek(uint64_t indep)
 {
-    m_series = s;
-    m_series_idx = idx;
-    m_offset = offset;
-    m_unpack = unpack_func(m_series);
-    m_input = fopen(name, "r");
-
-    if (!m_input || fseek(m_input, offset, SEEK_SET) < 0)
-    {
-        return false;
-    }
-
-    return true;
+    m_positioned = true;
+    return m_it->seek(std::max(indep, m_start));
 }
 
 bool
-series_iterator :: read(unsigned char* buf, size_t buf_sz)
+window_iterator :: weighted()
 {
-    if (m_error)
-    {
-        return false;
-    }
+    return m_it->weighted();
+}
 
-    if (fread(buf, 1, buf_sz, m_input) != buf_sz)
-    {
-        m_error = ferror(m_input) != 0;
-        m_eof = !m_error && feof(m_input) != 0;
-        return false;
-    }
+uint64_t
+window_iterator :: weight()
+{
+    return m_it->weight();
+}
 
-    return true;
+uint64_t
+window_iterator :: cycles_per_second()
+{
+    return m_it->cycles_per_second();
 }
 
-YGOR_API int
-ygor_data_iterator_sample(ygor_data_iterator* ydi,
-                          ygor_data_point* ydp, size_t ydp_sz,
-                          size_t* k, size_t* n)
+int64_t
+window_iterator :: read_batch(ygor_data_point* ydp, uint64_t* weights, size_t max)
 {
-    if (ydp_sz <= 0)
+    // the current point is in the window, so the batch keeps at least one
+    const int status = valid();
+
+    if (status <= 0 || max == 0)
     {
-        errno = EINVAL;
-        return -1;
+        return status < 0 ? -1 : 0;
     }
 
-    guacamole g;
-    guacamole_seed(&g, (intptr_t)ydi);
-    size_t elem = 0;
-    int status = 0;
+    const int64_t n = m_it->read_batch(ydp, weights, max);
+    int64_t kept = 0;
 
-    while ((status = ygor_data_iterator_valid(ydi)) > 0)
+    for (int64_t i = 0; i < n; ++i)
     {
-        ygor_data_point p;
-        ygor_data_iterator_read(ydi, &p);
-        ygor_data_iterator_advance(ydi);
-
-        if (elem < ydp_sz)
+        if (!contains(ydp[i].indep))
         {
-            ydp[elem] = p;
+            continue;
         }
-        else
-        {
-            size_t idx = guacamole_double(&g) * elem;
 
-            if (idx < ydp_sz)
-            {
-                ydp[idx] = p;
-            }
-        }
+        ydp[kept] = ydp[i];
 
-        ++elem;
-    }
+        if (weights)
+        {
+            weights[kept] = weights[i];
+        }
 
-    if (status < 0)
-    {
-        return -1;
+        ++kept;
     }
 
-    *n = elem;
-    *k = std::min(ydp_sz, *n);
-    return 0;
+    return n < 0 ? n : kept;
 }
 
-struct convert
-{
-    ygor_units from;
-    ygor_units to;
-    double rate;
-};
-
-static const convert conversion_rates[] = {{YGOR_UNIT_S, YGOR_UNIT_MS, 1000},
-                                           {YGOR_UNIT_S, YGOR_UNIT_US, 1000000},
-                                           {YGOR_UNIT_MS, YGOR_UNIT_US, 1000},
-                                           {YGOR_UNIT_US, YGOR_UNIT_S, 0.000001},
-                                           {YGOR_UNIT_US, YGOR_UNIT_MS, 0.001},
-                                           {YGOR_UNIT_MS, YGOR_UNIT_S, 0.001},
-                                           {YGOR_UNIT_BYTES, YGOR_UNIT_KBYTES, 0.001},
-                                           {YGOR_UNIT_BYTES, YGOR_UNIT_MBYTES, 0.000001},
-                                           {YGOR_UNIT_BYTES, YGOR_UNIT_GBYTES, 0.000000001},
-                                           {YGOR_UNIT_KBYTES, YGOR_UNIT_MBYTES, 0.001},
-                                           {YGOR_UNIT_KBYTES, YGOR_UNIT_GBYTES, 0.000001},
-                                           {YGOR_UNIT_MBYTES, YGOR_UNIT_GBYTES, 0.001},
-                                           {YGOR_UNIT_GBYTES, YGOR_UNIT_MBYTES, 1000},
-                                           {YGOR_UNIT_GBYTES, YGOR_UNIT_KBYTES, 1000000},
-                                           {YGOR_UNIT_GBYTES, YGOR_UNIT_BYTES, 1000000000},
-                                           {YGOR_UNIT_MBYTES, YGOR_UNIT_KBYTES, 1000},
-                                           {YGOR_UNIT_MBYTES, YGOR_UNIT_BYTES, 1000000},
-                                           {YGOR_UNIT_KBYTES, YGOR_UNIT_BYTES, 1000},
-                                           {(ygor_units)0, (ygor_units)0, 0}};
-
-YGOR_API int
-ygor_units_compatible(ygor_units from, ygor_units to)
+int64_t
+window_iterator :: read_columns(uint64_t* indep, double* dep, uint64_t* weights, size_t max)
 {
-    const convert* c = conversion_rates;
+    const ygor_series* s = series();
+    m_points.resize(std::max(max, size_t(1)));
+    const int64_t n = read_batch(&m_points[0], weights, max);
 
-    while (c->from && c->to)
+    for (int64_t i = 0; i < n; ++i)
     {
-        if (c->from == from && c->to == to)
+        if (indep)
         {
-            return true;
+            indep[i] = ygor_is_precise(s->indep_precision) ? m_points[i].indep.precise : uint64_t(m_points[i].indep.approximate);
         }
 
-        ++c;
+        dep[i] = value_to_double(s->dep_precision, m_points[i].dep);
     }
 
-    return from == to;
+    return n;
 }
 
-YGOR_API double
-ygor_units_conversion_ratio(ygor_units from, ygor_units to)
+// Skip the blocks wholly outside the window, and describe the next block if
+// it lies wholly within.
+bool
+window_iterator :: peek_block(index_entry* ie)
 {
-    assert(ygor_units_compatible(from, to));
-    const convert* c = conversion_rates;
+    if (position() < 0)
+    {
+        return false;
+    }
 
-    while (c->from && c->to)
+    while (m_it->peek_block(ie))
     {
-        if (c->from == from && c->to == to)
+        if (excludes(*ie))
         {
-            return c->rate;
+            m_it->skip_block();
+            continue;
         }
 
-        ++c;
+        return includes(*ie);
     }
 
-    assert(from == to);
-    return 1.0;
+    return false;
 }
 
-struct conversion_iterator : public ygor_data_iterator
+void
+window_iterator :: skip_block()
 {
-    conversion_iterator();
-    virtual ~conversion_iterator() throw ();
+    m_it->skip_block();
+}
 
-    virtual ygor_series* series();
-    virtual int valid();
-    virtual void advance();
-    virtual void read(ygor_data_point* ydp);
-    virtual int rewind();
+// Feeds a scan only what falls in a window_iterator's window
+struct window_scan : public block_scan
+{
+    window_scan(window_iterator* wi, block_scan* bs, bool owned);
+    virtual ~window_scan() throw ();
 
-    ygor_data_iterator* m_it;
-    ygor_series m_series;
-    double m_indep_scale;
-    double m_dep_scale;
+    virtual block_scan* partial();
+    virtual bool entry(const index_entry& ie);
+    virtual void points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz);
+    virtual void merge(block_scan* other);
+
+    window_iterator* m_wi;
+    block_scan* m_bs;
+    bool m_owned;
+    std::vector<ygor_data_point> m_points;
+    std::vector<uint64_t> m_weights;
 
     private:
-        conversion_iterator(const conversion_iterator&);
-        conversion_iterator& operator = (const conversion_iterator&);
+        window_scan(const window_scan&);
+        window_scan& operator = (const window_scan&);
 };
 
-YGOR_API struct ygor_data_iterator*
-ygor_data_convert_units(ygor_data_iterator* ydi,
-                        ygor_units new_indep_units,
-                        ygor_units new_dep_units)
+window_scan :: window_scan(window_iterator* wi, block_scan* bs, bool owned)
+    : m_wi(wi)
+    , m_bs(bs)
+    , m_owned(owned)
+    , m_points()
+    , m_weights()
 {
-    if (!ygor_units_compatible(ydi->series()->indep_units, new_indep_units) ||
-        !ygor_units_compatible(ydi->series()->dep_units, new_dep_units))
-    {
-        return NULL;
-    }
-
-    conversion_iterator* ci = new conversion_iterator();
-    ci->m_it = ydi;
-    ci->m_series = *ydi->series();
-
-    if (ydi->series()->indep_units != new_indep_units)
-    {
-        ci->m_series.indep_precision = approximate_precision(ci->m_series.indep_precision);
-    }
-
-    ci->m_series.indep_units = new_indep_units;
+}
 
-    if (ydi->series()->dep_units != new_dep_units)
+window_scan :: ~window_scan() throw ()
+{
+    if (m_owned)
     {
-        ci->m_series.dep_precision = approximate_precision(ci->m_series.dep_precision);
+        delete m_bs;
     }
-
-    ci->m_series.dep_units = new_dep_units;
-    ci->m_indep_scale = ygor_units_conversion_ratio(ydi->series()->indep_units, new_indep_units);
-    ci->m_dep_scale = ygor_units_conversion_ratio(ydi->series()->dep_units, new_dep_units);
-    return ci;
 }
 
-conversion_iterator :: conversion_iterator()
-    : m_it(NULL)
-    , m_series()
-    , m_indep_scale(1.0)
-    , m_dep_scale(1.0)
+block_scan*
+window_scan :: partial()
 {
+    return new window_scan(m_wi, m_bs->partial(), true);
 }
 
-conversion_iterator :: ~conversion_iterator() throw ()
+bool
+window_scan :: entry(const index_entry& ie)
 {
-    delete m_it;
-}
+    if (m_wi->excludes(ie))
+    {
+        return true;
+    }
 
-ygor_series*
-conversion_iterator :: series()
-{
-    return &m_series;
+    return m_wi->includes(ie) && m_bs->entry(ie);
 }
 
-int
-conversion_iterator :: valid()
+void
+window_scan :: points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz)
 {
-    return m_it->valid();
+    m_points.clear();
+    m_weights.clear();
+
+    for (size_t i = 0; i < ydp_sz; ++i)
+    {
+        if (m_wi->contains(ydp[i].indep))
+        {
+            m_points.push_back(ydp[i]);
+            m_weights.push_back(weights[i]);
+        }
+    }
+
+    if (!m_points.empty())
+    {
+        m_bs->points(&m_points[0], &m_weights[0], m_points.size());
+    }
 }
 
 void
-conversion_iterator :: advance()
+window_scan :: merge(block_scan* other)
 {
-    return m_it->advance();
+    m_bs->merge(static_cast<window_scan*>(other)->m_bs);
 }
 
-void
-conversion_iterator :: read(ygor_data_point* ydp)
+int
+window_iterator :: scan(block_scan* bs)
 {
-    m_it->read(ydp);
-
-    if (ygor_is_precise(m_series.indep_precision))
+    if (position() < 0)
     {
-        assert(m_indep_scale < 1.0001 && m_indep_scale > 0.9999);
-    }
-    else if (ygor_is_precise(ydp->series->indep_precision))
-    {
-        ydp->indep.approximate = ydp->indep.precise * m_indep_scale;
-    }
-    else
-    {
-        ydp->indep.approximate *= m_indep_scale;
+        return -1;
     }
 
-    if (ygor_is_precise(m_series.dep_precision))
-    {
-        assert(m_dep_scale < 1.0001 && m_dep_scale > 0.9999);
-    }
-    else if (ygor_is_precise(ydp->series->dep_precision))
+    window_scan ws(this, bs, false);
+    return m_it->scan(&ws);
+}
+
+int
+window_iterator :: position()
+{
+    if (m_positioned)
     {
-        ydp->dep.approximate = ydp->dep.precise * m_dep_scale;
+        return 0;
     }
-    else
+
+    if (m_it->seek(m_start) < 0)
     {
-        ydp->dep.approximate *= m_dep_scale;
+        return -1;
     }
 
-    ydp->series = &m_series;
+    m_positioned = true;
+    return 0;
 }
 
-int
-conversion_iterator :: rewind()
+bool
+window_iterator :: contains(const ygor_data_value& indep)
 {
-    return m_it->rewind();
+    const ygor_precision p = series()->indep_precision;
+    return !indep_before(p, indep, m_start) && indep_before(p, indep, m_end);
+}
+
+bool
+window_iterator :: excludes(const index_entry& ie)
+{
+    const ygor_precision p = series()->indep_precision;
+    ygor_data_value min;
+    ygor_data_value max;
+    memcpy(&min, &ie.min, sizeof(min));
+    memcpy(&max, &ie.max, sizeof(max));
+    return indep_before(p, max, m_start) || !indep_before(p, min, m_end);
+}
+
+bool
+window_iterator :: includes(const index_entry& ie)
+{
+    ygor_data_value min;
+    ygor_data_value max;
+    memcpy(&min, &ie.min, sizeof(min));
+    memcpy(&max, &ie.max, sizeof(max));
+    return contains(min) && contains(max);
 }
 
 bool
@@ -1433,69 +7390,128 @@ extract_dep_double(const ygor_data_point& ydp)
     return value;
 }
 
-YGOR_API int
-ygor_cdf(ygor_data_iterator* ydi, uint64_t step_value,
-         ygor_data_point** data, uint64_t* data_sz)
+// Counts of values by the step at or above them
+struct cdf_scan : public block_scan
 {
-    *data = NULL;
-    *data_sz = 0;
-    std::vector<ygor_data_point> points;
-    points.push_back(ygor_data_point());
-    points[0].series = ygor_data_iterator_series(ydi);
-    points[0].indep.precise = 0;
-    points[0].dep.precise = 0;
-    uint64_t num_points = 0;
-    int status = 0;
+    cdf_scan(const ygor_series* s, uint64_t step_value);
+    virtual ~cdf_scan() throw ();
+
+    virtual block_scan* partial();
+    virtual void points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz);
+    virtual void merge(block_scan* other);
+
+    const ygor_series* m_series;
+    uint64_t m_step;
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total;
+
+    private:
+        cdf_scan(const cdf_scan&);
+        cdf_scan& operator = (const cdf_scan&);
+};
+
+cdf_scan :: cdf_scan(const ygor_series* s, uint64_t step_value)
+    : m_series(s)
+    , m_step(step_value)
+    , m_counts(1, 0)
+    , m_total(0)
+{
+}
+
+cdf_scan :: ~cdf_scan() throw ()
+{
+}
+
+block_scan*
+cdf_scan :: partial()
+{
+    return new cdf_scan(m_series, m_step);
+}
 
-    while ((status = ygor_data_iterator_valid(ydi)) > 0)
+void
+cdf_scan :: points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz)
+{
+    for (size_t i = 0; i < ydp_sz; ++i)
     {
-        ygor_data_point ydp;
-        ygor_data_iterator_read(ydi, &ydp);
-        ygor_data_iterator_advance(ydi);
-        double value = extract_dep_double(ydp);
+        const double value = value_to_double(m_series->dep_precision, ydp[i].dep);
         size_t idx = 0;
 
-        while (points[idx].indep.precise < value)
+        // the first step at or above value
+        if (value > 0)
         {
-            if (idx + 1 == points.size())
+            idx = ceil(value / m_step);
+
+            while (idx > 0 && double((idx - 1) * m_step) >= value)
+            {
+                --idx;
+            }
+
+            while (double(idx * m_step) < value)
             {
-                ygor_data_point next;
-                next.series = points[idx].series;
-                next.indep.precise = points[idx].indep.precise + step_value;
-                next.dep.precise = 0;
-                points.push_back(next);
+                ++idx;
             }
+        }
 
-            ++idx;
+        if (idx >= m_counts.size())
+        {
+            m_counts.resize(idx + 1, 0);
         }
 
-        points[idx].dep.precise += 1;
-        ++num_points;
+        m_counts[idx] += weights[i];
+        m_total += weights[i];
+    }
+}
+
+void
+cdf_scan :: merge(block_scan* _other)
+{
+    cdf_scan* other = static_cast<cdf_scan*>(_other);
+
+    if (other->m_counts.size() > m_counts.size())
+    {
+        m_counts.resize(other->m_counts.size(), 0);
+    }
+
+    for (size_t i = 0; i < other->m_counts.size(); ++i)
+    {
+        m_counts[i] += other->m_counts[i];
     }
 
-    if (status < 0)
+    m_total += other->m_total;
+    other->m_counts.assign(1, 0);
+    other->m_total = 0;
+}
+
+YGOR_API int
+ygor_cdf(ygor_data_iterator* ydi, uint64_t step_value,
+         ygor_data_point** data, uint64_t* data_sz)
+{
+    *data = NULL;
+    *data_sz = 0;
+    dep_only d(ydi);
+    cdf_scan cs(ygor_data_iterator_series(ydi), step_value);
+
+    if (ydi->scan(&cs) < 0)
     {
         return -1;
     }
 
-    if (num_points == 0)
+    if (cs.m_total == 0)
     {
-        *data = NULL;
-        *data_sz = 0;
         return 0;
     }
 
     uint64_t sum = 0;
-    const size_t sz = sizeof(ygor_data_point) * points.size();
+    const size_t sz = sizeof(ygor_data_point) * cs.m_counts.size();
     *data = (ygor_data_point*)malloc(sz);
-    *data_sz = points.size();
+    *data_sz = cs.m_counts.size();
 
-    for (size_t i = 0; i < points.size(); ++i)
+    for (size_t i = 0; i < cs.m_counts.size(); ++i)
     {
-        (*data)[i].indep = points[i].indep;
-        sum += points[i].dep.precise;
+        (*data)[i].indep.precise = i * step_value;
+        sum += cs.m_counts[i];
         (*data)[i].dep.approximate = 100. * (double)sum
-                                          / (double)num_points;
+                                          / (double)cs.m_total;
     }
 
     return 0;
@@ -1503,6 +7519,56 @@ ygor_cdf(ygor_data_iterator* ydi, uint64_t step_value,
 
 #define PERCENTILE_BUFFER_SZ (1ULL << 10)
 
+// Weighted (histogram) series are already aggregated into few distinct
+// values, so the exact answer comes from one pass over their totals.
+static int
+weighted_percentile(ygor_data_iterator* ydi, double percentile, double* value)
+{
+    std::map<double, uint64_t> weights;
+    uint64_t n = 0;
+    std::vector<double> values(READ_BATCH_SIZE);
+    std::vector<uint64_t> counts(READ_BATCH_SIZE);
+    int64_t batch = 0;
+
+    while ((batch = ydi->read_columns(NULL, &values[0], &counts[0], READ_BATCH_SIZE)) > 0)
+    {
+        for (int64_t i = 0; i < batch; ++i)
+        {
+            weights[values[i]] += counts[i];
+            n += counts[i];
+        }
+    }
+
+    if (batch < 0)
+    {
+        return -1;
+    }
+
+    if (n == 0)
+    {
+        *value = NAN;
+        return 0;
+    }
+
+    const uint64_t which = (n - 1) * percentile;
+    uint64_t seen = 0;
+
+    for (std::map<double, uint64_t>::iterator it = weights.begin();
+            it != weights.end(); ++it)
+    {
+        seen += it->second;
+
+        if (which < seen)
+        {
+            *value = it->first;
+            return 0;
+        }
+    }
+
+    *value = weights.rbegin()->first;
+    return 0;
+}
+
 YGOR_API int
 ygor_percentile(ygor_data_iterator* ydi, double percentile, double* value)
 {
@@ -1512,6 +7578,13 @@ ygor_percentile(ygor_data_iterator* ydi, double percentile, double* value)
         return -1;
     }
 
+    dep_only d(ydi);
+
+    if (ydi->weighted())
+    {
+        return weighted_percentile(ydi, percentile, value);
+    }
+
     std::vector<ygor_data_point> sampled(PERCENTILE_BUFFER_SZ);
     size_t k = 0;
     size_t n = 0;
@@ -1575,8 +7648,34 @@ ygor_percentile(ygor_data_iterator* ydi, double percentile, double* value)
         size_t idx = 0;
         int status = 0;
 
-        while ((status = ygor_data_iterator_valid(ydi)) > 0)
+        while (true)
         {
+            index_entry ie;
+
+            // blocks entirely outside the cutoffs are counted undecoded, in
+            // stored points like n rather than the sampled population
+            if (ydi->peek_block(&ie))
+            {
+                if (ie.summary.dep_max < lower_cutoff)
+                {
+                    lower_count += ie.count;
+                    ydi->skip_block();
+                    continue;
+                }
+                else if (ie.summary.dep_min > lower_cutoff &&
+                         ie.summary.dep_min >= upper_cutoff)
+                {
+                    upper_count += ie.count;
+                    ydi->skip_block();
+                    continue;
+                }
+            }
+
+            if ((status = ygor_data_iterator_valid(ydi)) <= 0)
+            {
+                break;
+            }
+
             if (idx >= values.size())
             {
                 std::sort(values.begin(), values.end());
@@ -1628,9 +7727,12 @@ ygor_percentile(ygor_data_iterator* ydi, double percentile, double* value)
             return -1;
         }
 
+        // the series changed between passes, or its index disagrees with
+        // its blocks
         if (idx + lower_count + upper_count != n)
         {
-            abort(); // XXX
+            errno = EINVAL;
+            return -1;
         }
 
         const size_t which = (n - 1) * percentile;
@@ -1675,55 +7777,254 @@ ygor_percentile(ygor_data_iterator* ydi, double percentile, double* value)
     }
 }
 
-YGOR_API int
-ygor_timeseries(ygor_data_iterator* ydi, uint64_t step_value,
-                ygor_data_point** data, uint64_t* data_sz)
+static uint64_t
+timeseries_value(const ygor_series* s, const ygor_data_value& v)
 {
-    std::vector<ygor_data_point> points;
-    int status = 0;
-
-    while ((status = ygor_data_iterator_valid(ydi)) > 0)
+    if (!ygor_is_precise(s->indep_precision))
     {
-        ygor_data_point ydp;
-        ygor_data_iterator_read(ydi, &ydp);
-        ygor_data_iterator_advance(ydi);
-        uint64_t value = ydp.indep.precise;
+        return v.approximate;
+    }
+
+    return v.precise;
+}
+
+// Count weight values toward the step that contains value
+static void
+timeseries_count(std::vector<ygor_data_point>* points, const ygor_series* s,
+                 uint64_t value, uint64_t step_value, uint64_t weight)
+{
+    std::vector<ygor_data_point>::reverse_iterator rit = points->rbegin();
 
-        if (!ygor_is_precise(ydp.series->indep_precision))
+    while (rit != points->rend())
+    {
+        if (rit->indep.precise <= value && value < rit->indep.precise + step_value)
         {
-            value = ydp.indep.approximate;
+            break;
         }
 
-        std::vector<ygor_data_point>::reverse_iterator rit = points.rbegin();
+        ++rit;
+    }
 
-        while (rit != points.rend())
-        {
-            if (rit->indep.precise <= value && value < rit->indep.precise + step_value)
-            {
-                break;
-            }
+    if (rit == points->rend())
+    {
+        ygor_data_point ydp;
+        ydp.series = s;
+        ydp.indep.precise = (uint64_t)(value / step_value) * step_value;
+        ydp.dep.precise = weight;
+        points->push_back(ydp);
+        assert(ydp.indep.precise <= value && value < ydp.indep.precise + step_value);
+    }
+    else
+    {
+        rit->dep.precise += weight;
+    }
+}
 
-            ++rit;
-        }
+// Statistics over values, and the range of their independent values
+struct summary_scan : public block_scan
+{
+    summary_scan(const ygor_series* s);
+    virtual ~summary_scan() throw ();
 
-        if (rit == points.rend())
-        {
-            ydp.indep.precise = (uint64_t)(value / step_value) * step_value;
-            ydp.dep.precise = 1;
-            points.push_back(ydp);
-            assert(ydp.indep.precise <= value && value < ydp.indep.precise + step_value);
-        }
-        else
-        {
-            rit->dep.precise += 1;
-        }
+    virtual block_scan* partial();
+    virtual bool entry(const index_entry& ie);
+    virtual void points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz);
+    virtual void merge(block_scan* other);
+
+    const ygor_series* m_series;
+    block_summary m_total;
+    double m_indep_min;
+    double m_indep_max;
+
+    private:
+        summary_scan(const summary_scan&);
+        summary_scan& operator = (const summary_scan&);
+};
+
+summary_scan :: summary_scan(const ygor_series* s)
+    : m_series(s)
+    , m_total()
+    , m_indep_min(INFINITY)
+    , m_indep_max(-INFINITY)
+{
+}
+
+summary_scan :: ~summary_scan() throw ()
+{
+}
+
+block_scan*
+summary_scan :: partial()
+{
+    return new summary_scan(m_series);
+}
+
+// every block with an index entry is summarized from it without being read
+bool
+summary_scan :: entry(const index_entry& ie)
+{
+    ygor_data_value min;
+    ygor_data_value max;
+    memcpy(&min, &ie.min, sizeof(min));
+    memcpy(&max, &ie.max, sizeof(max));
+    m_indep_min = std::min(m_indep_min, value_to_double(m_series->indep_precision, min));
+    m_indep_max = std::max(m_indep_max, value_to_double(m_series->indep_precision, max));
+    m_total.add(ie.summary);
+    return true;
+}
+
+void
+summary_scan :: points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz)
+{
+    for (size_t i = 0; i < ydp_sz; ++i)
+    {
+        const double indep = value_to_double(m_series->indep_precision, ydp[i].indep);
+        m_indep_min = std::min(m_indep_min, indep);
+        m_indep_max = std::max(m_indep_max, indep);
+        m_total.add(indep, value_to_double(m_series->dep_precision, ydp[i].dep), weights[i]);
+    }
+}
+
+void
+summary_scan :: merge(block_scan* _other)
+{
+    summary_scan* other = static_cast<summary_scan*>(_other);
+    m_total.add(other->m_total);
+    m_indep_min = std::min(m_indep_min, other->m_indep_min);
+    m_indep_max = std::max(m_indep_max, other->m_indep_max);
+    other->m_total = block_summary();
+    other->m_indep_min = INFINITY;
+    other->m_indep_max = -INFINITY;
+}
+
+YGOR_API int
+ygor_summarize(ygor_data_iterator* ydi, ygor_summary* summary)
+{
+    summary_scan ss(ygor_data_iterator_series(ydi));
+
+    if (ydi->scan(&ss) < 0)
+    {
+        return -1;
+    }
+
+    const block_summary& total(ss.m_total);
+    memset(summary, 0, sizeof(*summary));
+
+    if (total.count == 0)
+    {
+        return 0;
+    }
+
+    const double n = total.count;
+    summary->points = total.count;
+    summary->indep_min = ss.m_indep_min;
+    summary->indep_max = ss.m_indep_max;
+    summary->min = total.dep_min;
+    summary->max = total.dep_max;
+    summary->mean = total.dep_sum / n;
+
+    if (total.count > 1)
+    {
+        summary->variance = std::max(0., (total.dep_sumsq - total.dep_sum * total.dep_sum / n) / (n - 1));
+        summary->stdev = sqrt(summary->variance);
+    }
+
+    return 0;
+}
+
+// Counts of values by the step of their independent values
+struct timeseries_scan : public block_scan
+{
+    timeseries_scan(const ygor_series* s, uint64_t step_value);
+    virtual ~timeseries_scan() throw ();
+
+    virtual block_scan* partial();
+    virtual bool entry(const index_entry& ie);
+    virtual void points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz);
+    virtual void merge(block_scan* other);
+
+    const ygor_series* m_series;
+    uint64_t m_step;
+    std::vector<ygor_data_point> m_points;
+
+    private:
+        timeseries_scan(const timeseries_scan&);
+        timeseries_scan& operator = (const timeseries_scan&);
+};
+
+timeseries_scan :: timeseries_scan(const ygor_series* s, uint64_t step_value)
+    : m_series(s)
+    , m_step(step_value)
+    , m_points()
+{
+}
+
+timeseries_scan :: ~timeseries_scan() throw ()
+{
+}
+
+block_scan*
+timeseries_scan :: partial()
+{
+    return new timeseries_scan(m_series, m_step);
+}
+
+// a block that falls within one step counts toward it undecoded
+bool
+timeseries_scan :: entry(const index_entry& ie)
+{
+    ygor_data_value min;
+    ygor_data_value max;
+    memcpy(&min, &ie.min, sizeof(min));
+    memcpy(&max, &ie.max, sizeof(max));
+    const uint64_t lower = timeseries_value(m_series, min);
+    const uint64_t upper = timeseries_value(m_series, max);
+
+    if (lower / m_step != upper / m_step)
+    {
+        return false;
+    }
+
+    timeseries_count(&m_points, m_series, lower, m_step, ie.summary.count);
+    return true;
+}
+
+void
+timeseries_scan :: points(const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz)
+{
+    for (size_t i = 0; i < ydp_sz; ++i)
+    {
+        timeseries_count(&m_points, m_series, timeseries_value(m_series, ydp[i].indep), m_step, weights[i]);
+    }
+}
+
+void
+timeseries_scan :: merge(block_scan* _other)
+{
+    timeseries_scan* other = static_cast<timeseries_scan*>(_other);
+
+    for (size_t i = 0; i < other->m_points.size(); ++i)
+    {
+        timeseries_count(&m_points, m_series, other->m_points[i].indep.precise,
+                         m_step, other->m_points[i].dep.precise);
     }
 
-    if (status < 0)
+    other->m_points.clear();
+}
+
+YGOR_API int
+ygor_timeseries(ygor_data_iterator* ydi, uint64_t step_value,
+                ygor_data_point** data, uint64_t* data_sz)
+{
+    timeseries_scan ts(ygor_data_iterator_series(ydi), step_value);
+
+    if (ydi->scan(&ts) < 0)
     {
         return -1;
     }
 
+    std::vector<ygor_data_point>& points(ts.m_points);
+
     if (points.empty())
     {
         *data = NULL;
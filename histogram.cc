@@ -0,0 +1,189 @@
+// Copyright (c) 2017, Robert Escriva
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of ygor nor the names of its contributors may be used
+//       to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// STL
+#include <algorithm>
+
+// e
+#include <e/varint.h>
+
+// ygor
+#include "histogram.h"
+
+uint64_t
+histogram :: num_buckets(unsigned precision)
+{
+    return uint64_t(65 - precision) << precision;
+}
+
+uint64_t
+histogram :: bucket(unsigned precision, uint64_t value)
+{
+    // the first two powers of two are counted exactly
+    if ((value >> (precision + 1)) == 0)
+    {
+        return value;
+    }
+
+    const unsigned shift = 63 - __builtin_clzll(value) - precision;
+    const uint64_t mask = (1ULL << precision) - 1;
+    return (uint64_t(shift + 1) << precision) | ((value >> shift) & mask);
+}
+
+uint64_t
+histogram :: bucket_lower(unsigned precision, uint64_t b)
+{
+    if ((b >> (precision + 1)) == 0)
+    {
+        return b;
+    }
+
+    const unsigned shift = (b >> precision) - 1;
+    const uint64_t mask = (1ULL << precision) - 1;
+    return ((b & mask) | (1ULL << precision)) << shift;
+}
+
+uint64_t
+histogram :: bucket_value(unsigned precision, uint64_t b)
+{
+    if ((b >> (precision + 1)) == 0)
+    {
+        return b;
+    }
+
+    // the middle of the bucket halves the worst case error
+    const unsigned shift = (b >> precision) - 1;
+    return bucket_lower(precision, b) + ((1ULL << shift) >> 1);
+}
+
+const unsigned char*
+histogram :: unpack(const unsigned char* in, const unsigned char* end,
+                    unsigned precision,
+                    std::vector<uint64_t>* buckets,
+                    std::vector<uint64_t>* counts)
+{
+    const uint64_t limit = num_buckets(precision);
+    uint64_t n = 0;
+    in = e::varint64_decode(in, end, &n);
+
+    if (!in || n > limit)
+    {
+        return NULL;
+    }
+
+    uint64_t b = 0;
+
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        uint64_t delta = 0;
+        uint64_t count = 0;
+        in = e::varint64_decode(in, end, &delta);
+        in = in ? e::varint64_decode(in, end, &count) : NULL;
+
+        // buckets are strictly increasing
+        if (!in || (i > 0 && delta == 0) || delta >= limit - b)
+        {
+            return NULL;
+        }
+
+        b += delta;
+        buckets->push_back(b);
+        counts->push_back(count);
+    }
+
+    return in;
+}
+
+histogram :: histogram(unsigned precision)
+    : m_precision(precision)
+    , m_counts(num_buckets(precision), 0)
+    , m_nonzero(0)
+    , m_lowest(m_counts.size())
+    , m_highest(0)
+{
+}
+
+histogram :: ~histogram() throw ()
+{
+}
+
+void
+histogram :: add(uint64_t value)
+{
+    const uint64_t b = bucket(m_precision, value);
+
+    if (m_counts[b]++ == 0)
+    {
+        ++m_nonzero;
+    }
+
+    m_lowest = std::min(m_lowest, b);
+    m_highest = std::max(m_highest, b);
+}
+
+void
+histogram :: clear()
+{
+    for (uint64_t b = m_lowest; b <= m_highest && b < m_counts.size(); ++b)
+    {
+        m_counts[b] = 0;
+    }
+
+    m_nonzero = 0;
+    m_lowest = m_counts.size();
+    m_highest = 0;
+}
+
+size_t
+histogram :: pack_size() const
+{
+    return (1 + 2 * m_nonzero) * VARINT_64_MAX_SIZE;
+}
+
+// The non-empty buckets in order, each as the distance from the previous
+// bucket and its count.
+unsigned char*
+histogram :: pack(unsigned char* out) const
+{
+    out = e::packvarint64(m_nonzero, out);
+    uint64_t prev = 0;
+
+    for (uint64_t b = m_lowest; b <= m_highest && b < m_counts.size(); ++b)
+    {
+        if (m_counts[b] == 0)
+        {
+            continue;
+        }
+
+        out = e::packvarint64(b - prev, out);
+        out = e::packvarint64(m_counts[b], out);
+        prev = b;
+    }
+
+    return out;
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2017, Robert Escriva
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of ygor nor the names of its contributors may be used
+//       to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef ygor_histogram_h_
+#define ygor_histogram_h_
+
+// C
+#include <stdint.h>
+#include <stdlib.h>
+
+// STL
+#include <vector>
+
+#define HISTOGRAM_MAX_PRECISION 12
+
+// A log-linear histogram in the style of HdrHistogram.  Values below
+// 2^precision each have a bucket of their own; above that, each power of two
+// is split into 2^precision equal buckets, so that no bucket is wider than
+// 1/2^precision of the values it counts.
+class histogram
+{
+    public:
+        static uint64_t num_buckets(unsigned precision);
+        static uint64_t bucket(unsigned precision, uint64_t value);
+        // the smallest value in bucket b and the value that stands in for it
+        static uint64_t bucket_lower(unsigned precision, uint64_t b);
+        static uint64_t bucket_value(unsigned precision, uint64_t b);
+        // decode what pack wrote into parallel arrays of buckets and counts
+        static const unsigned char* unpack(const unsigned char* in,
+                                           const unsigned char* end,
+                                           unsigned precision,
+                                           std::vector<uint64_t>* buckets,
+                                           std::vector<uint64_t>* counts);
+
+    public:
+        histogram(unsigned precision);
+        ~histogram() throw ();
+
+    public:
+        unsigned precision() const { return m_precision; }
+        bool empty() const { return m_nonzero == 0; }
+        // number of non-empty buckets
+        size_t nonzero() const { return m_nonzero; }
+        void add(uint64_t value);
+        void clear();
+        // an upper bound on the bytes pack will write
+        size_t pack_size() const;
+        unsigned char* pack(unsigned char* out) const;
+
+    private:
+        histogram(const histogram&);
+        histogram& operator = (const histogram&);
+
+    private:
+        unsigned m_precision;
+        std::vector<uint64_t> m_counts;
+        size_t m_nonzero;
+        // the range of buckets touched since the last clear
+        uint64_t m_lowest;
+        uint64_t m_highest;
+};
+
+#endif // ygor_histogram_h_
@@ -0,0 +1,88 @@
+/* Copyright (c) 2017, Robert Escriva
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of ygor nor the names of its contributors may be used
+ *       to endorse or promote products derived from this software without
+ *       specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ygor_clock_h_
+#define ygor_clock_h_
+
+/* C */
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/* Timestamps cheap enough to take twice per operation, for series recorded in
+ * YGOR_UNIT_CYCLES.  On x86-64 they read the time-stamp counter; elsewhere
+ * they fall back to CLOCK_MONOTONIC in nanoseconds.  The logger stores the
+ * calibration in the file, and ygor_data_convert_units turns cycles into
+ * time when the file is read.
+ */
+static inline uint64_t
+ygor_clock_cycles(void)
+{
+#if defined(__x86_64__)
+    uint32_t lo;
+    uint32_t hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Like ygor_clock_cycles, but waits for the instructions before it to finish,
+ * so that it may end a measurement without reading the counter early. */
+static inline uint64_t
+ygor_clock_cycles_end(void)
+{
+#if defined(__x86_64__)
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t aux;
+    __asm__ __volatile__ ("rdtscp" : "=a" (lo), "=d" (hi), "=c" (aux));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    return ygor_clock_cycles();
+#endif
+}
+
+/* The rate of ygor_clock_cycles, calibrated against CLOCK_MONOTONIC the
+ * first time it is called (which takes about YGOR_CLOCK_CALIBRATION_MS).
+ * Zero if the counter does not tick at a constant rate on this machine.
+ */
+#define YGOR_CLOCK_CALIBRATION_MS 20
+uint64_t ygor_clock_cycles_per_second(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+#endif /* ygor_clock_h_ */
@@ -43,6 +43,9 @@ enum ygor_units
     YGOR_UNIT_S   = 1,
     YGOR_UNIT_MS  = 2,
     YGOR_UNIT_US  = 3,
+    YGOR_UNIT_NS  = 4,
+    /* ygor_clock_cycles; see ygor/clock.h */
+    YGOR_UNIT_CYCLES   = 8,
     YGOR_UNIT_BYTES    = 9,
     YGOR_UNIT_KBYTES   = 10,
     YGOR_UNIT_MBYTES   = 11,
@@ -83,34 +86,226 @@ struct ygor_data_point
     union ygor_data_value dep;
 };
 
+struct ygor_data_logger_config;
+struct ygor_data_logger_config* ygor_data_logger_config_create();
+void ygor_data_logger_config_destroy(struct ygor_data_logger_config* ydlc);
+
+/* Buffer points in per-thread blocks instead of one shared block per series.
+ * Recording threads only synchronize with each other when a block fills and
+ * is handed off to be written.  Every thread must be done recording before the
+ * logger is flushed and destroyed.
+ */
+int ygor_data_logger_config_thread_local_buffers(struct ygor_data_logger_config* ydlc, int enable);
+/* Sort, pack, and write full blocks on a dedicated writer thread so that
+ * recording a point only ever swaps one block for another and never waits on
+ * I/O.  The writer may be pinned to a CPU (-1, the default, leaves it unpinned).
+ */
+int ygor_data_logger_config_background_writer(struct ygor_data_logger_config* ydlc, int enable);
+int ygor_data_logger_config_writer_cpu(struct ygor_data_logger_config* ydlc, int cpu);
+/* Number of points per block (default 1024).  Larger blocks mean fewer
+ * writes and block headers at the cost of memory per series and thread; the
+ * size is recorded in the file for readers.
+ */
+int ygor_data_logger_config_block_size(struct ygor_data_logger_config* ydlc, size_t points);
+/* Flush the logger from a thread of its own every interval (0, the default,
+ * never does) so that a run may be followed while in progress and loses at
+ * most an interval of points should it crash.
+ */
+int ygor_data_logger_config_flush_interval(struct ygor_data_logger_config* ydlc, uint64_t millis);
+/* Roll over to a new file once the current one reaches a size, or has been
+ * open for an interval (0, the default, never does).  With either set, the
+ * logger writes output.0000, output.0001, and so on, each a complete file
+ * with its own header and index.  Readers given the output name read the
+ * whole set as one input, and any one segment may be read by its own name.
+ */
+int ygor_data_logger_config_segment_bytes(struct ygor_data_logger_config* ydlc, uint64_t bytes);
+int ygor_data_logger_config_segment_interval(struct ygor_data_logger_config* ydlc, uint64_t millis);
+/* Write the output with pwrite instead of stdio, growing the file with
+ * fallocate this many bytes at a time (0, the default, uses stdio).  Blocks
+ * of different series are then written concurrently; a lock is held only to
+ * reserve the range of the file each block goes to.
+ */
+int ygor_data_logger_config_preallocate(struct ygor_data_logger_config* ydlc, uint64_t extent);
+/* Write the output as above, but submit each block as an asynchronous write
+ * through io_uring so that the thread that packed it moves on at once.  Where
+ * io_uring is unavailable (ygor was built without liburing, or the kernel
+ * refuses the ring), blocks are written with pwrite instead.
+ */
+int ygor_data_logger_config_io_uring(struct ygor_data_logger_config* ydlc, int enable);
+/* Bound the memory the background writer's queue of full blocks may use (0,
+ * the default, leaves it unbounded).  Once it is used up, and whenever
+ * recording would otherwise wait for a series' previous block to be written,
+ * the overload policy decides what happens to a full block.
+ */
+int ygor_data_logger_config_memory_budget(struct ygor_data_logger_config* ydlc, uint64_t bytes);
+enum ygor_overload_policy
+{
+    /* recording waits for memory, or for the write, to become available */
+    YGOR_OVERLOAD_BLOCK = 1,
+    /* the block's points are dropped, and the number dropped is recorded in
+     * an extra series named "ygor.dropped" at each flush: its independent
+     * values are wallclock milliseconds and its dependent values counts */
+    YGOR_OVERLOAD_DROP = 2
+};
+int ygor_data_logger_config_overload_policy(struct ygor_data_logger_config* ydlc,
+                                            enum ygor_overload_policy policy);
+/* Record this rate for series in cycles instead of calibrating the counter
+ * of the machine writing the file, as when rewriting a file recorded on
+ * another (0, the default, calibrates).
+ */
+int ygor_data_logger_config_cycles_per_second(struct ygor_data_logger_config* ydlc,
+                                              uint64_t rate);
+/* Encodings trade CPU for smaller files and may be combined per series.  The
+ * encoding is recorded in the file, but readers that predate an encoding
+ * cannot read series that use it.  Histogram series cannot be encoded.
+ */
+enum ygor_encoding
+{
+    /* Gorilla-style zigzagged deltas of deltas for precise independent values;
+     * evenly spaced timestamps cost one bit each */
+    YGOR_ENCODING_DELTA_OF_DELTA = 1,
+    /* Gorilla-style XOR with the previous value for single and double
+     * precision dependent values; lossless, unlike half precision */
+    YGOR_ENCODING_XOR = 2,
+    /* store each block's independent values followed by its dependent values
+     * so that each column decodes in a tight loop, and analyses that look
+     * only at dependent values (CDFs, percentiles) never decode the other */
+    YGOR_ENCODING_COLUMNAR = 4
+};
+int ygor_data_logger_config_series_encoding(struct ygor_data_logger_config* ydlc,
+                                            const struct ygor_series* series,
+                                            unsigned encoding);
+/* Aggregate a series' dependent values into a log-linear (HDR-style)
+ * histogram and write one snapshot of it per interval of independent values
+ * (e.g. per second of timestamps) instead of every point.  Values below
+ * 2^precision are counted exactly and larger values fall into buckets no
+ * wider than 1/2^precision of their magnitude, so 7 is within 1%; at most 12.
+ * Both values of the series must be precise.  Readers see one point per
+ * non-empty bucket at the start of its interval, weighted by its count.
+ * A series cannot be both a histogram and sampled or encoded.
+ */
+int ygor_data_logger_config_series_histogram(struct ygor_data_logger_config* ydlc,
+                                             const struct ygor_series* series,
+                                             uint64_t interval, unsigned precision);
+/* Sample a series as it is recorded.  Points the sample leaves out are
+ * rejected before they reach any buffer, at the cost of an atomic counter.
+ * The ratio of one-in-n and reservoir samples is recorded in the file, and
+ * readers weight each point by it so that counts, CDFs, and timeseries are
+ * scaled back up.  Histogram series cannot be sampled.
+ */
+enum ygor_sampling
+{
+    /* keep every nth point */
+    YGOR_SAMPLING_ONE_IN_N = 1,
+    /* keep one point chosen at random (with guacamole) from each run of n
+     * points, so that periodic behavior does not bias the sample */
+    YGOR_SAMPLING_RESERVOIR = 2,
+    /* keep at most n points per interval of independent values, which must be
+     * precise; the points kept are not weighted */
+    YGOR_SAMPLING_THROTTLE = 3
+};
+int ygor_data_logger_config_series_sampling(struct ygor_data_logger_config* ydlc,
+                                            const struct ygor_series* series,
+                                            enum ygor_sampling sampling,
+                                            uint64_t n, uint64_t interval);
+
 struct ygor_data_logger;
 struct ygor_data_logger* ygor_data_logger_create(const char* output,
                                                  const struct ygor_series** series,
                                                  size_t series_sz);
+struct ygor_data_logger* ygor_data_logger_create_with_config(const char* output,
+                                                             const struct ygor_series** series,
+                                                             size_t series_sz,
+                                                             const struct ygor_data_logger_config* ydlc);
+/* Write every partially filled block, and the histogram of any histogram
+ * series' current interval, to the file.  Recording may continue meanwhile.
+ */
+int ygor_data_logger_flush(struct ygor_data_logger* ydl);
 int ygor_data_logger_flush_and_destroy(struct ygor_data_logger* ydl);
 int ygor_data_logger_record(struct ygor_data_logger* ydl, struct ygor_data_point* ydp);
+/* Record many points in one call.  The series lookup and locking is done once
+ * per run of consecutive points that belong to the same series.
+ */
+int ygor_data_logger_record_batch(struct ygor_data_logger* ydl,
+                                  const struct ygor_data_point* ydp, size_t ydp_sz);
+/* Record sz points of one series from separate independent/dependent columns */
+int ygor_data_logger_record_columns(struct ygor_data_logger* ydl,
+                                    const struct ygor_series* series,
+                                    const union ygor_data_value* indep,
+                                    const union ygor_data_value* dep,
+                                    size_t sz);
+/* A handle names one of the series passed to create and records into it
+ * without looking up the series pointer.  Handles are only meaningful to the
+ * logger that issued them.
+ */
+typedef uint32_t ygor_series_handle;
+int ygor_data_logger_series_handle(struct ygor_data_logger* ydl,
+                                   const struct ygor_series* series,
+                                   ygor_series_handle* h);
+int ygor_data_logger_record_h(struct ygor_data_logger* ydl, ygor_series_handle h,
+                              union ygor_data_value indep, union ygor_data_value dep);
 
 struct ygor_data_reader;
 struct ygor_data_reader* ygor_data_reader_create(const char* input);
 void ygor_data_reader_destroy(struct ygor_data_reader* ydr);
+/* Let ygor_cdf, ygor_timeseries and ygor_summarize over the reader's
+ * iterators decode blocks from up to this many threads; the default is one. */
+int ygor_data_reader_threads(struct ygor_data_reader* ydr, long threads);
 size_t ygor_data_reader_num_series(struct ygor_data_reader* ydr);
 const struct ygor_series* ygor_data_reader_series(struct ygor_data_reader* ydr, size_t idx);
+/* The rate recorded for a series in cycles, or zero if there is none */
+uint64_t ygor_data_reader_cycles_per_second(struct ygor_data_reader* ydr, size_t idx);
 
 struct ygor_data_iterator;
 struct ygor_data_iterator* ygor_data_iterate(struct ygor_data_reader* ydr, const char* name);
 void ygor_data_iterator_destroy(struct ygor_data_iterator* ydi);
+/* Read every series of a file in one pass instead of one per series.  f is
+ * called with each block's points in the order the blocks were written, and
+ * the index of their series (as for ygor_data_reader_series); weights is NULL
+ * unless the series is a histogram or sampled.  A negative return from f ends
+ * the pass, and ygor_data_iterate_all returns -1.
+ */
+typedef int (*ygor_data_block_func)(void* arg, size_t series_idx,
+                                     const struct ygor_data_point* ydp,
+                                     const uint64_t* weights, size_t ydp_sz);
+int ygor_data_iterate_all(struct ygor_data_reader* ydr, ygor_data_block_func f, void* arg);
 const struct ygor_series* ygor_data_iterator_series(struct ygor_data_iterator* ydi);
 int ygor_data_iterator_valid(struct ygor_data_iterator* ydi);
 void ygor_data_iterator_advance(struct ygor_data_iterator* ydi);
 void ygor_data_iterator_read(struct ygor_data_iterator* ydi,
                              struct ygor_data_point* ydp);
+/* The number of recorded values the current point stands for; always 1 except
+ * for histogram and sampled series.  ygor_cdf, ygor_percentile, and
+ * ygor_timeseries account for it. */
+uint64_t ygor_data_iterator_weight(struct ygor_data_iterator* ydi);
+/* Read up to max of the points left in the current block and advance past
+ * them, returning how many were read, 0 at the end, or -1 on error.  These
+ * cost one call per block rather than three per point.  The columnar form
+ * takes dependent values as doubles and independent values as integers
+ * (rounded down if approximate), or skips them if indep is NULL; the other
+ * also returns each point's weight, unless weights is NULL.
+ */
+int64_t ygor_data_iterator_read_batch(struct ygor_data_iterator* ydi,
+                                      uint64_t* indep, double* dep, size_t max);
+int64_t ygor_data_iterator_read_points(struct ygor_data_iterator* ydi,
+                                       struct ygor_data_point* ydp,
+                                       uint64_t* weights, size_t max);
 int ygor_data_iterator_rewind(struct ygor_data_iterator* ydi);
+/* Start over at the first point whose independent value is at least indep,
+ * skipping the blocks of indexed files that end before it unread.  Series
+ * recorded from several threads may have blocks that overlap, and so points
+ * after it that precede indep; ygor_data_window filters those too. */
+int ygor_data_iterator_seek(struct ygor_data_iterator* ydi, uint64_t indep);
 int ygor_data_iterator_sample(struct ygor_data_iterator* ydi,
                               struct ygor_data_point* ydp, size_t ydp_sz,
                               size_t* k, size_t* n);
 struct ygor_data_iterator* ygor_data_convert_units(struct ygor_data_iterator* ydi,
                                                    enum ygor_units new_indep_units,
                                                    enum ygor_units new_dep_units);
+/* Restrict ydi, which the result takes over as ygor_data_convert_units does,
+ * to points whose independent values lie in [start, end). */
+struct ygor_data_iterator* ygor_data_window(struct ygor_data_iterator* ydi,
+                                            uint64_t start, uint64_t end);
 
 int ygor_cdf(struct ygor_data_iterator* ydi, uint64_t step_value,
              struct ygor_data_point** data, uint64_t* data_sz);
@@ -118,6 +313,23 @@ int ygor_percentile(struct ygor_data_iterator* ydi, double percentile, double* v
 int ygor_timeseries(struct ygor_data_iterator* ydi, uint64_t step_value,
                     struct ygor_data_point** data, uint64_t* data_sz);
 
+struct ygor_summary
+{
+    uint64_t points;
+    /* the range of the independent values */
+    double indep_min;
+    double indep_max;
+    /* the dependent values */
+    double min;
+    double max;
+    double mean;
+    double stdev;
+    double variance;
+};
+/* Summarize the iterator's remaining points.  Blocks of files with an index
+ * are summarized from it without being read. */
+int ygor_summarize(struct ygor_data_iterator* ydi, struct ygor_summary* summary);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
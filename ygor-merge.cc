@@ -55,18 +55,18 @@ series_equal(const ygor_series& lhs, const ygor_series& rhs)
            lhs.dep_precision == rhs.dep_precision;
 }
 
-bool
-has_series(ygor_data_reader* ydr, const char* name)
+size_t
+series_index(const std::vector<const ygor_series*>& series, const char* name)
 {
-    for (size_t i = 0; i < ygor_data_reader_num_series(ydr); ++i)
+    for (size_t i = 0; i < series.size(); ++i)
     {
-        if (strcmp(ygor_data_reader_series(ydr, i)->name, name) == 0)
+        if (strcmp(name, series[i]->name) == 0)
         {
-            return true;
+            return i;
         }
     }
 
-    return false;
+    return series.size();
 }
 
 bool
@@ -109,6 +109,93 @@ approximate_heap_func(const ygor_data_point& lhs, const ygor_data_point& rhs)
     return lhs.indep.approximate > rhs.indep.approximate;
 }
 
+typedef bool (*heap_func_t)(const ygor_data_point& lhs, const ygor_data_point& rhs);
+
+// Every output series' heap, which points from each input's blocks join until
+// the heap is full
+struct merge_state
+{
+    merge_state(ygor_data_logger* ydl,
+                const std::vector<const ygor_series*>& series,
+                uint64_t heap_max);
+
+    ygor_data_logger* ydl;
+    const std::vector<const ygor_series*>& series;
+    std::vector<std::vector<ygor_data_point> > heaps;
+    std::vector<heap_func_t> heap_funcs;
+    uint64_t heap_max;
+    // the output series of each series of the input being read
+    std::vector<size_t> input;
+    bool failed;
+    // the series that stopped the merge by being weighted, or NULL
+    const ygor_series* weighted;
+
+    private:
+        merge_state(const merge_state&);
+        merge_state& operator = (const merge_state&);
+};
+
+merge_state :: merge_state(ygor_data_logger* y,
+                           const std::vector<const ygor_series*>& s,
+                           uint64_t hm)
+    : ydl(y)
+    , series(s)
+    , heaps(s.size())
+    , heap_funcs(s.size())
+    , heap_max(hm)
+    , input()
+    , failed(false)
+    , weighted(NULL)
+{
+    for (size_t i = 0; i < series.size(); ++i)
+    {
+        heap_funcs[i] = ygor_is_precise(series[i]->indep_precision)
+                      ? precise_heap_func : approximate_heap_func;
+    }
+}
+
+// Histogram and sampled series arrive weighted.  A logger cannot record a
+// point's weight, nor be told a series was sampled already, so merging them
+// would lose their counts; they are refused instead.
+int
+merge_block(void* arg, size_t series_idx, const ygor_data_point* ydp, const uint64_t* weights, size_t ydp_sz)
+{
+    merge_state* ms = static_cast<merge_state*>(arg);
+    const size_t s = ms->input[series_idx];
+
+    if (weights)
+    {
+        ms->weighted = ms->series[s];
+        return -1;
+    }
+
+    std::vector<ygor_data_point>& points(ms->heaps[s]);
+    heap_func_t heap_func = ms->heap_funcs[s];
+
+    for (size_t i = 0; i < ydp_sz; ++i)
+    {
+        assert(series_equal(*ydp[i].series, *ms->series[s]));
+        points.push_back(ydp[i]);
+        points.back().series = ms->series[s];
+        std::push_heap(points.begin(), points.end(), heap_func);
+
+        if (points.size() > ms->heap_max)
+        {
+            std::pop_heap(points.begin(), points.end(), heap_func);
+
+            if (ygor_data_logger_record(ms->ydl, &points.back()) < 0)
+            {
+                ms->failed = true;
+                return -1;
+            }
+
+            points.pop_back();
+        }
+    }
+
+    return 0;
+}
+
 int
 main(int argc, const char* argv[])
 {
@@ -145,6 +232,10 @@ main(int argc, const char* argv[])
 
     std::vector<ygor_data_reader*> readers;
     std::vector<const ygor_series*> series;
+    // the rate of every input's series in cycles, which the output keeps
+    // rather than calibrating this machine's
+    uint64_t cycles_per_second = 0;
+    bool has_cycles = false;
 
     for (size_t i = 0; i < ap.args_sz(); ++i)
     {
@@ -172,12 +263,37 @@ main(int argc, const char* argv[])
             {
                 series.push_back(s);
             }
+
+            if (s->indep_units != YGOR_UNIT_CYCLES && s->dep_units != YGOR_UNIT_CYCLES)
+            {
+                continue;
+            }
+
+            const uint64_t rate = ygor_data_reader_cycles_per_second(ydr, j);
+
+            if (rate == 0)
+            {
+                fprintf(stderr, "series %s in input %s is in cycles but records no rate\n", s->name, ap.args()[i]);
+                return EXIT_FAILURE;
+            }
+
+            if (has_cycles && rate != cycles_per_second)
+            {
+                fprintf(stderr, "input %s records cycles at a different rate than the other inputs\n", ap.args()[i]);
+                return EXIT_FAILURE;
+            }
+
+            cycles_per_second = rate;
+            has_cycles = true;
         }
     }
 
     const uint64_t heap_max = buffer_sz * 1048576ULL / sizeof(ygor_data_point) + 1;
     std::cout << "heap max " << heap_max << std::endl;
-    ygor_data_logger* ydl = ygor_data_logger_create(out, &series[0], series.size());
+    ygor_data_logger_config* ydlc = ygor_data_logger_config_create();
+    ygor_data_logger_config_cycles_per_second(ydlc, cycles_per_second);
+    ygor_data_logger* ydl = ygor_data_logger_create_with_config(out, &series[0], series.size(), ydlc);
+    ygor_data_logger_config_destroy(ydlc);
 
     if (!ydl)
     {
@@ -185,72 +301,40 @@ main(int argc, const char* argv[])
         return EXIT_FAILURE;
     }
 
-    for (size_t s = 0; s < series.size(); ++s)
+    merge_state ms(ydl, series, heap_max / series.size() + 1);
+
+    // read each input once, rather than once per series
+    for (size_t r = 0; r < readers.size(); ++r)
     {
-        bool (*heap_func)(const ygor_data_point& lhs, const ygor_data_point& rhs);
+        ms.input.clear();
 
-        if (ygor_is_precise(series[s]->indep_precision))
-        {
-            heap_func = precise_heap_func;
-        }
-        else
+        for (size_t i = 0; i < ygor_data_reader_num_series(readers[r]); ++i)
         {
-            heap_func = approximate_heap_func;
+            ms.input.push_back(series_index(series, ygor_data_reader_series(readers[r], i)->name));
         }
 
-        std::vector<ygor_data_point> points;
-
-        for (size_t r = 0; r < readers.size(); ++r)
+        if (ygor_data_iterate_all(readers[r], merge_block, &ms) < 0)
         {
-            if (!has_series(readers[r], series[s]->name))
+            if (ms.weighted)
             {
-                continue;
+                fprintf(stderr, "series %s in input %s is a histogram or sampled, and cannot be merged\n", ms.weighted->name, ap.args()[r]);
             }
-
-            ygor_data_iterator* ydi = ygor_data_iterate(readers[r], series[s]->name);
-
-            if (!ydi)
+            else
             {
-                fprintf(stderr, "could not open series %s:%s\n", ap.args()[r], series[s]->name);
-                return EXIT_FAILURE;
+                fprintf(stderr, ms.failed ? "error writing output\n" : "error reading input %s\n", ap.args()[r]);
             }
 
-            int status;
-
-            while ((status = ygor_data_iterator_valid(ydi)) > 0)
-            {
-                ygor_data_point ydp;
-                ygor_data_iterator_read(ydi, &ydp);
-                ygor_data_iterator_advance(ydi);
-                assert(series_equal(*ydp.series, *series[s]));
-                ydp.series = series[s];
-                points.push_back(ydp);
-                std::push_heap(points.begin(), points.end(), heap_func);
-
-                if (points.size() > heap_max)
-                {
-                    std::pop_heap(points.begin(), points.end(), heap_func);
-
-                    if (ygor_data_logger_record(ydl, &points.back()) < 0)
-                    {
-                        fprintf(stderr, "error writing output\n");
-                        return EXIT_FAILURE;
-                    }
-
-                    points.pop_back();
-                }
-            }
-
-            if (status < 0)
-            {
-                fprintf(stderr, "error reading series %s:%s\n", ap.args()[r], series[s]->name);
-                return EXIT_FAILURE;
-            }
+            return EXIT_FAILURE;
         }
+    }
+
+    for (size_t s = 0; s < series.size(); ++s)
+    {
+        std::vector<ygor_data_point>& points(ms.heaps[s]);
 
         while (!points.empty())
         {
-            std::pop_heap(points.begin(), points.end(), heap_func);
+            std::pop_heap(points.begin(), points.end(), ms.heap_funcs[s]);
 
             if (ygor_data_logger_record(ydl, &points.back()) < 0)
             {
@@ -81,13 +81,15 @@ main(int argc, const char* argv[])
             .as_string(&pcs_str);
     scale_options sopts;
     ap.add("Scale options:", sopts.parser());
+    window_options wopts;
+    ap.add("Window options:", wopts.parser());
 
     if (!ap.parse(argc, argv))
     {
         return EXIT_FAILURE;
     }
 
-    if (!sopts.validate())
+    if (!sopts.validate() || !wopts.validate())
     {
         return EXIT_FAILURE;
     }
@@ -138,6 +140,7 @@ main(int argc, const char* argv[])
 
         if (!(ydr = ygor_data_reader_create(series[i].filename.c_str())) ||
             !(ydi = ygor_data_iterate(ydr, series[i].series_name.c_str())) ||
+            !(ydi = wopts.apply(ydi)) ||
             !(ydi = ygor_data_convert_units(ydi, ygor_data_iterator_series(ydi)->indep_units, sopts.units())))
         {
             fprintf(stderr, "cannot create iterator from input %s\n", ap.args()[i]);
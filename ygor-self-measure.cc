@@ -39,15 +39,36 @@
 #include <e/popt.h>
 
 // ygor
+#include <ygor/clock.h>
 #include <ygor/data.h>
 
 uint32_t done = 0;
+bool cycles = false;
 
 void
 recorder(ygor_data_logger* ydl, ygor_series* s, long usleep)
 {
     ygor_data_point ydp;
     ydp.series = s;
+
+    if (cycles)
+    {
+        ydp.indep.precise = ygor_clock_cycles();
+        ydp.dep.precise = 0;
+
+        while (!e::atomic::load_32_nobarrier(&done))
+        {
+            uint64_t start = ygor_clock_cycles();
+            int ret = ygor_data_logger_record(ydl, &ydp);
+            uint64_t end = ygor_clock_cycles_end();
+            assert(ret == 0);
+            ydp.indep.precise = end;
+            ydp.dep.precise = end - start;
+        }
+
+        return;
+    }
+
     ydp.indep.precise = po6::wallclock_time() / PO6_MILLIS;
     ydp.dep.approximate = 1;
 
@@ -105,6 +126,20 @@ main(int argc, const char* argv[])
     long usleeps = 0;
     const char* output = "benchmark.dat";
     const char* precision = "double";
+    bool thread_local_buffers = false;
+    bool background_writer = false;
+    long writer_cpu = -1;
+    long block_size = 1024;
+    long flush_interval = 0;
+    long segment_bytes = 0;
+    long segment_interval = 0;
+    long preallocate = 0;
+    bool io_uring = false;
+    long memory_budget = 0;
+    bool drop = false;
+    long sample = 0;
+    long reservoir = 0;
+    long throttle = 0;
     e::argparser ap;
     ap.autohelp();
     ap.arg().name('t', "threads")
@@ -119,6 +154,51 @@ main(int argc, const char* argv[])
     ap.arg().name('p', "precision")
             .description("precision of the measurements (default: precise)")
             .as_string(&precision);
+    ap.arg().name('l', "thread-local")
+            .description("buffer measurements in per-thread blocks (default: shared)")
+            .set_true(&thread_local_buffers);
+    ap.arg().name('w', "writer")
+            .description("write blocks from a background thread (default: inline)")
+            .set_true(&background_writer);
+    ap.arg().long_name("writer-cpu")
+            .description("pin the background writer to this CPU (default: unpinned)")
+            .as_long(&writer_cpu);
+    ap.arg().name('b', "block-size")
+            .description("number of points per block (default: 1024)")
+            .as_long(&block_size);
+    ap.arg().name('f', "flush-interval")
+            .description("flush buffered measurements every this many milliseconds (default: don't)")
+            .as_long(&flush_interval);
+    ap.arg().long_name("segment-bytes")
+            .description("roll over to a new output segment every this many bytes (default: don't)")
+            .as_long(&segment_bytes);
+    ap.arg().long_name("segment-interval")
+            .description("roll over to a new output segment every this many milliseconds (default: don't)")
+            .as_long(&segment_interval);
+    ap.arg().long_name("preallocate")
+            .description("write with pwrite, preallocating this many bytes at a time (default: use stdio)")
+            .as_long(&preallocate);
+    ap.arg().long_name("io-uring")
+            .description("write through io_uring where available (default: don't)")
+            .set_true(&io_uring);
+    ap.arg().long_name("memory-budget")
+            .description("bytes of blocks that may wait for the writer (default: unbounded)")
+            .as_long(&memory_budget);
+    ap.arg().long_name("drop")
+            .description("drop points rather than wait when overloaded (default: wait)")
+            .set_true(&drop);
+    ap.arg().long_name("sample")
+            .description("keep one in this many measurements (default: all)")
+            .as_long(&sample);
+    ap.arg().long_name("reservoir")
+            .description("keep one measurement chosen at random from every this many (default: all)")
+            .as_long(&reservoir);
+    ap.arg().long_name("throttle")
+            .description("keep at most this many measurements per second (default: all)")
+            .as_long(&throttle);
+    ap.arg().long_name("cycles")
+            .description("time with the cycle counter and record cycles (default: wallclock)")
+            .set_true(&cycles);
 
     if (!ap.parse(argc, argv))
     {
@@ -144,8 +224,57 @@ main(int argc, const char* argv[])
         return EXIT_FAILURE;
     }
 
+    if (cycles)
+    {
+        s.indep_units = YGOR_UNIT_CYCLES;
+        s.dep_units = YGOR_UNIT_CYCLES;
+        s.dep_precision = YGOR_PRECISE_INTEGER;
+    }
+
+    ygor_data_logger_config* ydlc = ygor_data_logger_config_create();
+
+    int sampled = 0;
+
+    if (ydlc && sample > 0)
+    {
+        sampled = ygor_data_logger_config_series_sampling(ydlc, &s, YGOR_SAMPLING_ONE_IN_N, sample, 0);
+    }
+    else if (ydlc && reservoir > 0)
+    {
+        sampled = ygor_data_logger_config_series_sampling(ydlc, &s, YGOR_SAMPLING_RESERVOIR, reservoir, 0);
+    }
+    else if (ydlc && throttle > 0)
+    {
+        const uint64_t second = cycles ? ygor_clock_cycles_per_second() : 1000;
+        sampled = ygor_data_logger_config_series_sampling(ydlc, &s, YGOR_SAMPLING_THROTTLE, throttle, second);
+    }
+
+    if (!ydlc || sampled < 0 ||
+        ygor_data_logger_config_thread_local_buffers(ydlc, thread_local_buffers) < 0 ||
+        ygor_data_logger_config_background_writer(ydlc, background_writer) < 0 ||
+        ygor_data_logger_config_writer_cpu(ydlc, writer_cpu) < 0 ||
+        block_size <= 0 ||
+        ygor_data_logger_config_block_size(ydlc, block_size) < 0 ||
+        flush_interval < 0 ||
+        ygor_data_logger_config_flush_interval(ydlc, flush_interval) < 0 ||
+        segment_bytes < 0 ||
+        ygor_data_logger_config_segment_bytes(ydlc, segment_bytes) < 0 ||
+        segment_interval < 0 ||
+        ygor_data_logger_config_segment_interval(ydlc, segment_interval) < 0 ||
+        preallocate < 0 ||
+        ygor_data_logger_config_preallocate(ydlc, preallocate) < 0 ||
+        ygor_data_logger_config_io_uring(ydlc, io_uring) < 0 ||
+        memory_budget < 0 ||
+        ygor_data_logger_config_memory_budget(ydlc, memory_budget) < 0 ||
+        ygor_data_logger_config_overload_policy(ydlc, drop ? YGOR_OVERLOAD_DROP : YGOR_OVERLOAD_BLOCK) < 0)
+    {
+        fprintf(stderr, "could not configure data logger\n");
+        return EXIT_FAILURE;
+    }
+
     const ygor_series* ss[] = {&s};
-    ygor_data_logger* ydl = ygor_data_logger_create(output, ss, 1);
+    ygor_data_logger* ydl = ygor_data_logger_create_with_config(output, ss, 1, ydlc);
+    ygor_data_logger_config_destroy(ydlc);
 
     if (!ydl)
     {
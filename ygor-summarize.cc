@@ -26,74 +26,96 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 // C
-#include <cmath>
 #include <cstdlib>
 #include <stdint.h>
 
+// POSIX
+#include <unistd.h>
+
+// STL
+#include <algorithm>
+
 // e
 #include <e/popt.h>
 
 // ygor
-#include "ygor.h"
-#include "ygor-internal.h"
+#include <ygor/data.h>
+#include "common.h"
 
 int
 main(int argc, const char* argv[])
 {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
     e::argparser ap;
     ap.autohelp();
-    ap.option_string("[<data-set> ...]");
-    scale_opts so;
-    ap.add("Units:", so.parser());
+    ap.option_string("<input> [<input> ...]");
+    ap.arg().name('j', "threads")
+            .description("Decode with this many threads (default: one per CPU)")
+            .as_long(&threads);
+    scale_options sopts;
+    ap.add("Scale options:", sopts.parser());
 
     if (!ap.parse(argc, argv))
     {
         return EXIT_FAILURE;
     }
 
-    std::vector<ygor_summary> summs;
-    summs.resize(ap.args_sz());
+    if (!sopts.validate())
+    {
+        return EXIT_FAILURE;
+    }
 
-    for (size_t i = 0; i < ap.args_sz(); ++i)
+    if (ap.args_sz() < 1)
     {
-        if (ygor_summarize(ap.args()[i], &summs[i]) < 0)
-        {
-            fprintf(stderr, "cannot summarize input %s\n", ap.args()[i]);
-            return EXIT_FAILURE;
-        }
+        fprintf(stderr, "specify at least one input file\n");
+        return EXIT_FAILURE;
     }
 
+    std::vector<series_description> series = compute_series(ap.args(), ap.args_sz());
+    assert(series.size() == ap.args_sz());
+    std::vector<ygor_summary> summs(series.size());
+    std::vector<ygor_units> indep_units(series.size());
     size_t input_sz = 0;
 
-    for (size_t i = 0; i < ap.args_sz(); ++i)
+    for (size_t i = 0; i < series.size(); ++i)
     {
-        uint64_t scale;
-        const char* scale_str;
+        ygor_data_reader* ydr = NULL;
+        ygor_data_iterator* ydi = NULL;
 
-        if (!so.scale(summs[i].mean, &scale, &scale_str))
+        if (!(ydr = ygor_data_reader_create(series[i].filename.c_str())) ||
+            ygor_data_reader_threads(ydr, threads) < 0 ||
+            !(ydi = ygor_data_iterate(ydr, series[i].series_name.c_str())) ||
+            !(ydi = ygor_data_convert_units(ydi, ygor_data_iterator_series(ydi)->indep_units, sopts.units())))
         {
+            fprintf(stderr, "cannot create iterator from input %s\n", ap.args()[i]);
             return EXIT_FAILURE;
         }
 
-        input_sz = std::max(input_sz, strlen(ap.args()[i]));
-    }
-
-    for (size_t i = 0; i < ap.args_sz(); ++i)
-    {
-        uint64_t scale;
-        const char* scale_str;
-
-        if (!so.scale(summs[i].mean, &scale, &scale_str))
+        if (ygor_summarize(ydi, &summs[i]) < 0)
         {
+            fprintf(stderr, "cannot summarize input %s\n", ap.args()[i]);
             return EXIT_FAILURE;
         }
 
-        fprintf(stdout, "%-*s n=%ld time=%lu%s throughput=%g mean=%g%s stdev=%g%s\n",
-                        int(input_sz), ap.args()[i], summs[i].points,
-                        summs[i].nanos / scale, scale_str,
-                        (summs[i].points * 1000ULL * 1000ULL * 1000.)/ summs[i].nanos,
-                        summs[i].mean / scale, scale_str,
-                        summs[i].stdev / scale, scale_str);
+        indep_units[i] = ygor_data_iterator_series(ydi)->indep_units;
+        input_sz = std::max(input_sz, strlen(ap.args()[i]));
+        ygor_data_iterator_destroy(ydi);
+        ygor_data_reader_destroy(ydr);
+    }
+
+    const char* units = units_to_str(sopts.units());
+
+    for (size_t i = 0; i < series.size(); ++i)
+    {
+        const double span = summs[i].indep_max - summs[i].indep_min;
+        fprintf(stdout, "%-*s n=%llu span=%g%s throughput=%g/%s mean=%g%s stdev=%g%s min=%g%s max=%g%s\n",
+                        int(input_sz), ap.args()[i], (unsigned long long)summs[i].points,
+                        span, units_to_str(indep_units[i]),
+                        span > 0 ? summs[i].points / span : 0, units_to_str(indep_units[i]),
+                        summs[i].mean, units,
+                        summs[i].stdev, units,
+                        summs[i].min, units,
+                        summs[i].max, units);
     }
 
     return EXIT_SUCCESS;
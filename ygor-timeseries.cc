@@ -29,6 +29,9 @@
 #include <cstdlib>
 #include <stdint.h>
 
+// POSIX
+#include <unistd.h>
+
 // e
 #include <e/popt.h>
 
@@ -39,18 +42,24 @@
 int
 main(int argc, const char* argv[])
 {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
     e::argparser ap;
     ap.autohelp();
     ap.option_string("<input> [<input> ...]");
+    ap.arg().name('j', "threads")
+            .description("Decode with this many threads (default: one per CPU)")
+            .as_long(&threads);
     bucket_options bopts;
     ap.add("Bucket options:", bopts.parser());
+    window_options wopts;
+    ap.add("Window options:", wopts.parser());
 
     if (!ap.parse(argc, argv))
     {
         return EXIT_FAILURE;
     }
 
-    if (!bopts.validate())
+    if (!bopts.validate() || !wopts.validate())
     {
         return EXIT_FAILURE;
     }
@@ -72,7 +81,9 @@ main(int argc, const char* argv[])
         size_t ydp_sz;
 
         if (!(ydr = ygor_data_reader_create(series[i].filename.c_str())) ||
+            ygor_data_reader_threads(ydr, threads) < 0 ||
             !(ydi = ygor_data_iterate(ydr, series[i].series_name.c_str())) ||
+            !(ydi = wopts.apply(ydi)) ||
             !(ydi = ygor_data_convert_units(ydi, bopts.units(), ygor_data_iterator_series(ydi)->dep_units)) ||
             ygor_timeseries(ydi, bopts.bucket(), &ydp, &ydp_sz) < 0)
         {
@@ -24,6 +24,7 @@
 # OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+import array
 import collections
 
 from cpython cimport bool
@@ -44,6 +45,8 @@ cdef extern from "ygor/data.h":
         YGOR_UNIT_S   = 1
         YGOR_UNIT_MS  = 2
         YGOR_UNIT_US  = 3
+        YGOR_UNIT_NS  = 4
+        YGOR_UNIT_CYCLES   = 8
         YGOR_UNIT_BYTES    = 9
         YGOR_UNIT_KBYTES   = 10
         YGOR_UNIT_MBYTES   = 11
@@ -77,8 +80,20 @@ cdef extern from "ygor/data.h":
     ygor_data_logger* ygor_data_logger_create(const char* output,
                                               const ygor_series** series,
                                               size_t series_sz)
+    int ygor_data_logger_flush(ygor_data_logger* ydl)
     int ygor_data_logger_flush_and_destroy(ygor_data_logger* ydl)
     int ygor_data_logger_record(ygor_data_logger* ydl, ygor_data_point* ydp)
+    int ygor_data_logger_record_columns(ygor_data_logger* ydl,
+                                        const ygor_series* series,
+                                        const ygor_data_value* indep,
+                                        const ygor_data_value* dep,
+                                        size_t sz)
+    ctypedef uint32_t ygor_series_handle
+    int ygor_data_logger_series_handle(ygor_data_logger* ydl,
+                                       const ygor_series* series,
+                                       ygor_series_handle* h)
+    int ygor_data_logger_record_h(ygor_data_logger* ydl, ygor_series_handle h,
+                                  ygor_data_value indep, ygor_data_value dep)
 
 cdef extern from "ygor-internal.h":
     int ygor_is_precise(ygor_precision p)
@@ -88,6 +103,8 @@ Series = collections.namedtuple('Series', ('name', 'indep_units', 'indep_precisi
 units_conversion = {'s': YGOR_UNIT_S,
                     'ms': YGOR_UNIT_MS,
                     'us': YGOR_UNIT_US,
+                    'ns': YGOR_UNIT_NS,
+                    'cycles': YGOR_UNIT_CYCLES,
                     'B': YGOR_UNIT_BYTES,
                     'KB': YGOR_UNIT_KBYTES,
                     'MB': YGOR_UNIT_MBYTES,
@@ -99,6 +116,22 @@ precision_conversion = {'precise': YGOR_PRECISE_INTEGER,
                         'single': YGOR_SINGLE_PRECISION,
                         'double': YGOR_DOUBLE_PRECISION}
 
+cdef uint64_t[::1] _precise_column(values):
+    cdef uint64_t[::1] column
+    try:
+        column = values
+    except (TypeError, ValueError):
+        column = array.array('Q', values)
+    return column
+
+cdef double[::1] _approximate_column(values):
+    cdef double[::1] column
+    try:
+        column = values
+    except (TypeError, ValueError):
+        column = array.array('d', values)
+    return column
+
 cdef class __series:
 
     cdef bytes name
@@ -150,6 +183,11 @@ cdef class DataLogger:
         if self.ys:
             free(self.ys)
 
+    def flush(self):
+        assert(self.dl)
+        if ygor_data_logger_flush(self.dl) < 0:
+            raise RuntimeError("could not flush data logger")
+
     def flush_and_destroy(self):
         assert(self.dl)
         ygor_data_logger_flush_and_destroy(self.dl)
@@ -171,3 +209,61 @@ cdef class DataLogger:
             ydp.dep.approximate = dep
         if ygor_data_logger_record(self.dl, &ydp) < 0:
             raise RuntimeError("could not log data record")
+
+    def record_batch(self, str _series, indep, dep):
+        cdef bytes series = _series.encode('utf8')
+        assert series in self.series
+        idx = self.series_idxs[series]
+        cdef const ygor_series* ys = self.ys[idx]
+        # numpy arrays of the matching dtype are used in place; anything else
+        # is copied into a contiguous array first
+        cdef uint64_t[::1] indep_precise
+        cdef double[::1] indep_approximate
+        cdef uint64_t[::1] dep_precise
+        cdef double[::1] dep_approximate
+        cdef const ygor_data_value* indep_ptr
+        cdef const ygor_data_value* dep_ptr
+        cdef size_t sz = len(indep)
+        if len(dep) != sz:
+            raise ValueError("independent and dependent values differ in length")
+        if sz == 0:
+            return
+        if ygor_is_precise(ys.indep_precision):
+            indep_precise = _precise_column(indep)
+            indep_ptr = <const ygor_data_value*>&indep_precise[0]
+        else:
+            indep_approximate = _approximate_column(indep)
+            indep_ptr = <const ygor_data_value*>&indep_approximate[0]
+        if ygor_is_precise(ys.dep_precision):
+            dep_precise = _precise_column(dep)
+            dep_ptr = <const ygor_data_value*>&dep_precise[0]
+        else:
+            dep_approximate = _approximate_column(dep)
+            dep_ptr = <const ygor_data_value*>&dep_approximate[0]
+        if ygor_data_logger_record_columns(self.dl, ys, indep_ptr, dep_ptr, sz) < 0:
+            raise RuntimeError("could not log data records")
+
+    def series_handle(self, str _series):
+        cdef bytes series = _series.encode('utf8')
+        assert series in self.series
+        idx = self.series_idxs[series]
+        cdef ygor_series_handle h
+        if ygor_data_logger_series_handle(self.dl, self.ys[idx], &h) < 0:
+            raise KeyError("unknown series")
+        return h
+
+    def record_h(self, ygor_series_handle h, indep, dep):
+        assert h < self.ys_sz
+        cdef const ygor_series* ys = self.ys[h]
+        cdef ygor_data_value i
+        cdef ygor_data_value d
+        if ygor_is_precise(ys.indep_precision):
+            i.precise = indep
+        else:
+            i.approximate = indep
+        if ygor_is_precise(ys.dep_precision):
+            d.precise = dep
+        else:
+            d.approximate = dep
+        if ygor_data_logger_record_h(self.dl, h, i, d) < 0:
+            raise RuntimeError("could not log data record")